@@ -0,0 +1,190 @@
+// crc32.cpp -- CRC-32 of a data stream, shared by zip.cpp and unzip.cpp
+//
+// The byte-wise table and slicing-by-8 follow crc32.c from zlib, by Mark
+// Adler. The folding kernel follows "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ Instruction" (Gopal et al., Intel, 2009),
+// with the bit-reflected constants for the zip polynomial 0xedb88320.
+// All the kernels work on the conditioned crc register; zcrc32() does the
+// one's complement before and after.
+
+#include <stdint.h>
+#include <string.h>
+#include "crc32.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC_PCLMUL
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__) && !defined(__AARCH64EB__) && defined(__linux__)
+#define CRC_ARMV8
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1<<7)
+#endif
+#ifdef __clang__
+#define CRC_ARMV8_TARGET __attribute__((target("crc")))
+#else
+#define CRC_ARMV8_TARGET __attribute__((target("+crc")))
+#endif
+#endif
+
+typedef uint32_t (*crc_kernel)(uint32_t c, const unsigned char *buf, size_t len);
+
+// crc_tables[k][n] is the crc of the byte n followed by k zero bytes
+static uint32_t crc_tables[8][256];
+
+static void make_crc_tables()
+{ for (uint32_t n=0; n<256; n++)
+  { uint32_t c=n;
+    for (int k=0; k<8; k++) c = (c&1) ? 0xedb88320U^(c>>1) : c>>1;
+    crc_tables[0][n]=c;
+  }
+  for (uint32_t n=0; n<256; n++)
+  { uint32_t c=crc_tables[0][n];
+    for (int k=1; k<8; k++) {c=crc_tables[0][c&0xff]^(c>>8); crc_tables[k][n]=c;}
+  }
+}
+
+static uint32_t crc_bytes(uint32_t c, const unsigned char *buf, size_t len)
+{ while (len--) c = crc_tables[0][(c^*buf++)&0xff]^(c>>8);
+  return c;
+}
+
+static uint32_t crc_slice8(uint32_t c, const unsigned char *buf, size_t len)
+{ while (len>=8)
+  { // the loads are spelled out byte by byte so that this works whatever the
+    // byte order; compilers turn them into a single 32-bit load where they can.
+    uint32_t lo = c ^ ((uint32_t)buf[0] | (uint32_t)buf[1]<<8 | (uint32_t)buf[2]<<16 | (uint32_t)buf[3]<<24);
+    uint32_t hi = (uint32_t)buf[4] | (uint32_t)buf[5]<<8 | (uint32_t)buf[6]<<16 | (uint32_t)buf[7]<<24;
+    c = crc_tables[7][lo&0xff] ^ crc_tables[6][(lo>>8)&0xff] ^ crc_tables[5][(lo>>16)&0xff] ^ crc_tables[4][lo>>24]
+      ^ crc_tables[3][hi&0xff] ^ crc_tables[2][(hi>>8)&0xff] ^ crc_tables[1][(hi>>16)&0xff] ^ crc_tables[0][hi>>24];
+    buf+=8; len-=8;
+  }
+  return crc_bytes(c,buf,len);
+}
+
+
+#ifdef CRC_PCLMUL
+// crc_fold: len must be at least 64 and a multiple of 16. Four 128-bit lanes
+// are folded forward by 64 bytes at a time, then folded into one lane, which
+// is reduced to 64 then 32 bits (Barrett reduction).
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc_fold(uint32_t c, const unsigned char *buf, size_t len)
+{ const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+  const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  __m128i x0,x1,x2,x3,x4,x5,x6,x7,x8;
+
+  x1 = _mm_loadu_si128((const __m128i*)(buf+0x00));
+  x2 = _mm_loadu_si128((const __m128i*)(buf+0x10));
+  x3 = _mm_loadu_si128((const __m128i*)(buf+0x20));
+  x4 = _mm_loadu_si128((const __m128i*)(buf+0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)c));
+  buf+=64; len-=64;
+
+  x0 = k1k2;
+  while (len>=64)
+  { x5 = _mm_clmulepi64_si128(x1,x0,0x00); x1 = _mm_clmulepi64_si128(x1,x0,0x11);
+    x6 = _mm_clmulepi64_si128(x2,x0,0x00); x2 = _mm_clmulepi64_si128(x2,x0,0x11);
+    x7 = _mm_clmulepi64_si128(x3,x0,0x00); x3 = _mm_clmulepi64_si128(x3,x0,0x11);
+    x8 = _mm_clmulepi64_si128(x4,x0,0x00); x4 = _mm_clmulepi64_si128(x4,x0,0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1,x5), _mm_loadu_si128((const __m128i*)(buf+0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2,x6), _mm_loadu_si128((const __m128i*)(buf+0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3,x7), _mm_loadu_si128((const __m128i*)(buf+0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4,x8), _mm_loadu_si128((const __m128i*)(buf+0x30)));
+    buf+=64; len-=64;
+  }
+
+  // fold the four lanes into one, then any 16-byte blocks left
+  x0 = k3k4;
+  x5 = _mm_clmulepi64_si128(x1,x0,0x00); x1 = _mm_clmulepi64_si128(x1,x0,0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1,x2),x5);
+  x5 = _mm_clmulepi64_si128(x1,x0,0x00); x1 = _mm_clmulepi64_si128(x1,x0,0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1,x3),x5);
+  x5 = _mm_clmulepi64_si128(x1,x0,0x00); x1 = _mm_clmulepi64_si128(x1,x0,0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1,x4),x5);
+  while (len>=16)
+  { x2 = _mm_loadu_si128((const __m128i*)buf);
+    x5 = _mm_clmulepi64_si128(x1,x0,0x00); x1 = _mm_clmulepi64_si128(x1,x0,0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1,x2),x5);
+    buf+=16; len-=16;
+  }
+
+  // 128 bits down to 64
+  x2 = _mm_clmulepi64_si128(x1,x0,0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1,8),x2);
+  x0 = k5k0;
+  x2 = _mm_srli_si128(x1,4);
+  x1 = _mm_and_si128(x1,mask32);
+  x1 = _mm_clmulepi64_si128(x1,x0,0x00);
+  x1 = _mm_xor_si128(x1,x2);
+
+  // Barrett reduction down to 32
+  x0 = poly;
+  x2 = _mm_and_si128(x1,mask32);
+  x2 = _mm_clmulepi64_si128(x2,x0,0x10);
+  x2 = _mm_and_si128(x2,mask32);
+  x2 = _mm_clmulepi64_si128(x2,x0,0x00);
+  x1 = _mm_xor_si128(x1,x2);
+  return (uint32_t)_mm_extract_epi32(x1,1);
+}
+
+static uint32_t crc_pclmul(uint32_t c, const unsigned char *buf, size_t len)
+{ if (len>=64)
+  { size_t n = len&~(size_t)15;
+    c=crc_fold(c,buf,n); buf+=n; len-=n;
+  }
+  return crc_slice8(c,buf,len);
+}
+#endif
+
+
+#ifdef CRC_ARMV8
+CRC_ARMV8_TARGET
+static uint32_t crc_armv8(uint32_t c, const unsigned char *buf, size_t len)
+{ while (len && ((uintptr_t)buf&7)) {c=__crc32b(c,*buf++); len--;}
+  while (len>=32)
+  { uint64_t w[4]; memcpy(w,buf,32);
+    c=__crc32d(c,w[0]); c=__crc32d(c,w[1]); c=__crc32d(c,w[2]); c=__crc32d(c,w[3]);
+    buf+=32; len-=32;
+  }
+  while (len>=8) {uint64_t w; memcpy(&w,buf,8); c=__crc32d(c,w); buf+=8; len-=8;}
+  while (len--) c=__crc32b(c,*buf++);
+  return c;
+}
+#endif
+
+
+// crc_kernel_ok: checks a kernel against the byte-wise table, for every
+// length up to a few hundred bytes and from an unaligned start.
+static bool crc_kernel_ok(crc_kernel kernel)
+{ unsigned char test[300];
+  for (size_t i=0; i<sizeof(test); i++) test[i]=(unsigned char)(i*131+7);
+  for (size_t len=0; len<sizeof(test); len++)
+  { if (kernel(0xffffffffU,test+1,len)!=crc_bytes(0xffffffffU,test+1,len)) return false;
+  }
+  return true;
+}
+
+static crc_kernel crc_select()
+{ make_crc_tables();
+#ifdef CRC_PCLMUL
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1") && crc_kernel_ok(crc_pclmul)) return crc_pclmul;
+#endif
+#ifdef CRC_ARMV8
+  if ((getauxval(AT_HWCAP)&HWCAP_CRC32) && crc_kernel_ok(crc_armv8)) return crc_armv8;
+#endif
+  return crc_slice8;
+}
+
+
+unsigned long zcrc32(unsigned long crc, const unsigned char *buf, size_t len)
+{ static const crc_kernel kernel = crc_select(); // once, and thread-safe
+  if (buf==NULL) return 0L;
+  return kernel((uint32_t)crc^0xffffffffU,buf,len)^0xffffffffU;
+}
@@ -0,0 +1,20 @@
+#ifndef _crc32_H
+#define _crc32_H
+
+// CRC-32 shared by zip.cpp and unzip.cpp.
+//
+// zcrc32 updates a running crc with the bytes buf[0..len-1] and returns the
+// updated crc, exactly like crc32() in zlib. The initial value is 0, and the
+// pre- and post-conditioning (one's complement) is done here.
+//
+// The kernel is picked once, at the first call, from what the CPU offers:
+// carry-less multiply folding (PCLMULQDQ) on x86, the CRC32 instructions
+// on ARMv8, and slicing-by-8 tables everywhere else. An accelerated kernel
+// is only used if it gives the same result as the byte-wise table on a
+// test buffer, so the output never depends on the machine.
+
+#include <stddef.h>
+
+unsigned long zcrc32(unsigned long crc, const unsigned char *buf, size_t len);
+
+#endif
@@ -19,11 +19,15 @@
 #define lumkdir(t) (mkdir(t))
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #define lumkdir(t) (mkdir(t,0755))
+#define LU_MMAP // files can be memory-mapped, see ZIP_MAPPED
 #endif
 #include <sys/types.h>
 #include <sys/stat.h>
 #include "unzip.h"
+#include "crc32.h"
 //
 typedef unsigned short WORD;
 #define _tcslen strlen
@@ -47,6 +51,7 @@ typedef unsigned short WORD;
 #include <string.h>
 #include <tchar.h>
 #include "unzip.h"
+#include "crc32.h"
 #endif
 //
 #ifdef UNICODE
@@ -121,6 +126,7 @@ typedef unsigned short WORD;
 #define ZIP_HANDLE   1
 #define ZIP_FILENAME 2
 #define ZIP_MEMORY   3
+#define ZIP_MAPPED   4 // a file (by name), mapped in memory where the system allows it
 
 
 #define zmalloc(len) malloc(len)
@@ -245,6 +251,8 @@ bool FileExists(const TCHAR *fn)
 
 
 
+typedef unsigned long long ZPOS64_T; // 64-bit sizes and offsets, for Zip64
+
 // unz_global_info structure contain global data about the ZIPfile
 typedef struct unz_global_info_s
 { unsigned long number_entry;         // total number of entries in the central dir on this disk
@@ -259,8 +267,8 @@ typedef struct unz_file_info_s
   unsigned long compression_method;   // compression method              2 bytes
   unsigned long dosDate;              // last mod file date in Dos fmt   4 bytes
   unsigned long crc;                  // crc-32                          4 bytes
-  unsigned long compressed_size;      // compressed size                 4 bytes
-  unsigned long uncompressed_size;    // uncompressed size               4 bytes
+  ZPOS64_T compressed_size;           // compressed size                 4 bytes (8 in Zip64)
+  ZPOS64_T uncompressed_size;         // uncompressed size               4 bytes (8 in Zip64)
   unsigned long size_filename;        // filename length                 2 bytes
   unsigned long size_file_extra;      // extra field length              2 bytes
   unsigned long size_file_comment;    // file comment length             2 bytes
@@ -1174,7 +1182,7 @@ int inflate_codes(inflate_blocks_statef *s, z_streamp z, int r)
   {             // waiting for "i:"=input, "o:"=output, "x:"=nothing
     case START:         // x: set up for LEN
 #ifndef SLOW
-      if (m >= 258 && n >= 10)
+      if (m >= 258 && n >= 16)
       {
         UPDATE
         r = inflate_fast(c->lbits, c->dbits, c->ltree, c->dtree, s, z);
@@ -2074,14 +2082,36 @@ z_streamp )             // for memory allocation
 //struct inflate_codes_state {int dummy;}; // for buggy compilers
 
 
-// macros for bit input with no checking and for returning unused bytes
-#define GRABBITS(j) {while(k<(j)){b|=((uLong)NEXTBYTE)<<k;k+=8;}}
-#define UNGRAB {c=z->avail_in-n;c=(k>>3)<c?k>>3:c;n+=c;p-=c;k-=c<<3;}
+// This is the fast loop rewritten for 64-bit machines. The bit buffer is a
+// 64-bit word refilled eight bytes at a time instead of one byte at a time,
+// which leaves enough bits for a whole length/distance pair (at most 48) or
+// for two literals in a row without checking the input again. Matches are
+// copied eight bytes at a time when they do not overlap within a word and
+// there is room in the window to write a few bytes past their end.
+
+typedef unsigned long long inflate_bitbuf;  // 64-bit bit buffer of inflate_fast
+
+// read 8 bytes of input as a little-endian word
+static inline inflate_bitbuf inflate_load64(const Byte *p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  inflate_bitbuf v; memcpy(&v,p,8); return v;
+#else
+  inflate_bitbuf v=0; for (int i=7; i>=0; i--) v=(v<<8)|p[i]; return v;
+#endif
+}
+
+// macros for bit input with no checking and for returning unused bytes.
+// REFILL tops the buffer up to at least 56 bits. It reads a whole word but
+// only consumes the bytes that fit, so the bits above k are the next input
+// bits; UNGRAB clears them before the buffer goes back to inflate_codes.
+#define REFILL {if(k<56){c=(63-k)>>3; b|=inflate_load64(p)<<k; p+=c; n-=c; k|=56;}}
+#define UNGRAB {c=z->avail_in-n;c=(k>>3)<c?k>>3:c;n+=c;p-=c;k-=c<<3;b&=(((inflate_bitbuf)1)<<k)-1;}
 
 // Called with number of bytes left to write in window at least 258
 // (the maximum string length) and number of input bytes available
-// at least ten.  The ten bytes are six bytes for the longest length/
-// distance pair plus four bytes for overloading the bit buffer.
+// at least sixteen. Each round refills once and uses at most six bytes,
+// and the refill reads eight bytes, so sixteen bytes always cover a round.
 
 int inflate_fast(
 uInt bl, uInt bd,
@@ -2092,7 +2122,7 @@ z_streamp z)
 {
   const inflate_huft *t;      // temporary pointer
   uInt e;               // extra bits or operation
-  uLong b;              // bit buffer
+  inflate_bitbuf b;     // bit buffer
   uInt k;               // bits in bit buffer
   Byte *p;             // input data pointer
   uInt n;               // bytes available there
@@ -2112,9 +2142,9 @@ z_streamp z)
   md = inflate_mask[bd];
 
   // do until not enough input or output space for fast loop
-  do {                          // assume called with m >= 258 && n >= 10
-    // get literal/length code
-    GRABBITS(20)                // max bits for literal/length code
+  while (m >= 258 && n >= 16)
+  {
+    REFILL                      // at least 56 bits from here on
     if ((e = (t = tl + ((uInt)b & ml))->exop) == 0)
     {
       DUMPBITS(t->bits)
@@ -2123,6 +2153,11 @@ z_streamp z)
                 "inflate:         * literal 0x%02x\n", t->base));
       *q++ = (Byte)t->base;
       m--;
+      // at least 41 bits are left, enough to look up a second literal
+      if ((e = (t = tl + ((uInt)b & ml))->exop) != 0) continue;
+      DUMPBITS(t->bits)
+      *q++ = (Byte)t->base;
+      m--;
       continue;
     }
     for (;;) {
@@ -2136,7 +2171,6 @@ z_streamp z)
         LuTracevv((stderr, "inflate:         * length %u\n", c));
 
         // decode distance base of block to copy
-        GRABBITS(15);           // max bits for distance code
         e = (t = td + ((uInt)b & md))->exop;
         for (;;) {
           DUMPBITS(t->bits)
@@ -2144,7 +2178,6 @@ z_streamp z)
           {
             // get extra bits to add to distance base
             e &= 15;
-            GRABBITS(e)         // get extra bits (up to 13)
             d = t->base + ((uInt)b & inflate_mask[e]);
             DUMPBITS(e)
             LuTracevv((stderr, "inflate:         * distance %u\n", d));
@@ -2171,17 +2204,27 @@ z_streamp z)
               }
               else                              // normal copy
               {
-                *q++ = *r++;  c--;
-                *q++ = *r++;  c--;
                 do {
                     *q++ = *r++;
                 } while (--c);
               }
             }
-            else                                /* normal copy */
+            else if (d >= 8 && m >= 8)          // wide copy, may write up to 7 bytes past the string
+            {
+              Byte *qe = q + c;
+              do {
+                memcpy(q, r, 8);
+                q += 8;  r += 8;
+              } while (q < qe);
+              q = qe;
+            }
+            else if (d == 1)                    // run of one byte
+            {
+              memset(q, *r, c);
+              q += c;
+            }
+            else                                // normal copy
             {
-              *q++ = *r++;  c--;
-              *q++ = *r++;  c--;
               do {
                 *q++ = *r++;
               } while (--c);
@@ -2232,7 +2275,7 @@ z_streamp z)
         return Z_DATA_ERROR;
       }
     };
-  } while (m >= 258 && n >= 10);
+  }
 
   // not enough input or output--restore pointers and return
   UNGRAB
@@ -2316,17 +2359,8 @@ const uLong * get_crc_table()
 { return (const uLong *)crc_table;
 }
 
-#define CRC_DO1(buf) crc = crc_table[((int)crc ^ (*buf++)) & 0xff] ^ (crc >> 8);
-#define CRC_DO2(buf)  CRC_DO1(buf); CRC_DO1(buf);
-#define CRC_DO4(buf)  CRC_DO2(buf); CRC_DO2(buf);
-#define CRC_DO8(buf)  CRC_DO4(buf); CRC_DO4(buf);
-
 uLong ucrc32(uLong crc, const Byte *buf, uInt len)
-{ if (buf == Z_NULL) return 0L;
-  crc = crc ^ 0xffffffffL;
-  while (len >= 8)  {CRC_DO8(buf); len -= 8;}
-  if (len) do {CRC_DO1(buf);} while (--len);
-  return crc ^ 0xffffffffL;
+{ return zcrc32(crc,buf,len); // shared with zip.cpp, see crc32.cpp
 }
 
 
@@ -2508,11 +2542,18 @@ int inflateEnd(z_streamp z)
 }
 
 
+int inflateInitW(z_streamp z, int w);
+
 int inflateInit2(z_streamp z)
+{ return inflateInitW(z,-15); // MAX_WBITS: 32K LZ77 window, raw deflate data (as stored in zip files)
+}
+
+// w is log2 of the window size. A negative value means raw deflate data,
+// a positive one means a zlib stream (2-byte header, deflate data, adler32 trailer).
+int inflateInitW(z_streamp z, int w)
 { const char *version = ZLIB_VERSION; int stream_size = sizeof(z_stream);
   if (version == Z_NULL || version[0] != ZLIB_VERSION[0] || stream_size != sizeof(z_stream)) return Z_VERSION_ERROR;
 
-  int w = -15; // MAX_WBITS: 32K LZ77 window.
   // Warning: reducing MAX_WBITS makes minigzip unable to extract .gz files created by gzip.
   // The memory requirements for deflate are (in bytes):
   //            (1 << (windowBits+2)) +  (1 << (memLevel+9))
@@ -2709,7 +2750,7 @@ int inflate(z_streamp z, int f)
 
 
 
-#define UNZ_BUFSIZE (16384)
+#define UNZ_BUFSIZE (65536)
 #define UNZ_MAXFILENAMEINZIP (256)
 #define SIZECENTRALDIRITEM (0x2e)
 #define SIZEZIPLOCALHEADER (0x1e)
@@ -2722,7 +2763,7 @@ const char unz_copyright[] = " unzip 0.15 Copyright 1998 Gilles Vollant ";
 // unz_file_info_interntal contain internal info about a file in zipfile
 typedef struct unz_file_info_internal_s
 {
-    uLong offset_curfile;// relative offset of local header 4 bytes
+    ZPOS64_T offset_curfile;// relative offset of local header 4 bytes (8 in Zip64)
 } unz_file_info_internal;
 
 
@@ -2730,15 +2771,35 @@ typedef struct
 { bool is_handle; // either a handle or memory
   bool canseek;
   // for handles:
-  HANDLE h; bool herr; unsigned long initial_offset; bool mustclosehandle;
+  HANDLE h; bool herr; ZPOS64_T initial_offset; bool mustclosehandle;
   // for memory:
-  void *buf; unsigned int len,pos; // if it's a memory block
+  void *buf; ZPOS64_T len,pos; // if it's a memory block
+  bool mapped;                 // the memory block is a mapped file, to unmap at close
 } LUFILE;
 
 
 LUFILE *lufopen(void *z,unsigned int len,DWORD flags,ZRESULT *err)
-{ if (flags!=ZIP_HANDLE && flags!=ZIP_FILENAME && flags!=ZIP_MEMORY) {*err=ZR_ARGS; return NULL;}
+{ if (flags!=ZIP_HANDLE && flags!=ZIP_FILENAME && flags!=ZIP_MEMORY && flags!=ZIP_MAPPED) {*err=ZR_ARGS; return NULL;}
   //
+  if (flags==ZIP_MAPPED)
+  { // the whole file is mapped read-only, then read like a memory block.
+    // Where it can't be (no mmap, empty file, not a regular file), it's read as a file.
+#ifdef LU_MMAP
+    int fd=open((const char*)z,O_RDONLY);
+    if (fd<0) {*err=ZR_NOFILE; return NULL;}
+    struct stat st; void *map=MAP_FAILED;
+    if (fstat(fd,&st)==0 && S_ISREG(st.st_mode) && st.st_size>0) map=mmap(0,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if (map!=MAP_FAILED)
+    { LUFILE *lf = new LUFILE;
+      lf->is_handle=false; lf->canseek=true; lf->mustclosehandle=false; lf->mapped=true;
+      lf->buf=map; lf->len=(ZPOS64_T)st.st_size; lf->pos=0; lf->initial_offset=0;
+      *err=ZR_OK;
+      return lf;
+    }
+#endif
+    flags=ZIP_FILENAME;
+  }
   HANDLE h=0; bool canseek=false; *err=ZR_OK;
   bool mustclosehandle=false;
   if (flags==ZIP_HANDLE||flags==ZIP_FILENAME)
@@ -2766,6 +2827,7 @@ LUFILE *lufopen(void *z,unsigned int len,DWORD flags,ZRESULT *err)
     canseek = (res!=0xFFFFFFFF);
   }
   LUFILE *lf = new LUFILE;
+  lf->mapped=false;
   if (flags==ZIP_HANDLE||flags==ZIP_FILENAME)
   { lf->is_handle=true; lf->mustclosehandle=mustclosehandle;
     lf->canseek=canseek;
@@ -2788,6 +2850,9 @@ int lufclose(LUFILE *stream)
 { if (stream==NULL) return EOF;
 #ifdef ZIP_STD
   if (stream->mustclosehandle) fclose(stream->h);
+#ifdef LU_MMAP
+  if (stream->mapped) munmap(stream->buf,(size_t)stream->len);
+#endif
 #else
   if (stream->mustclosehandle) CloseHandle(stream->h);
 #endif
@@ -2800,21 +2865,30 @@ int luferror(LUFILE *stream)
   else return 0;
 }
 
-long int luftell(LUFILE *stream)
-{ if (stream->is_handle && stream->canseek) return GetFilePosU(stream->h)-stream->initial_offset;
+ZPOS64_T luftell(LUFILE *stream)
+{ if (stream->is_handle && stream->canseek)
+  {
+#ifdef ZIP_STD
+    return (ZPOS64_T)ftello(stream->h)-stream->initial_offset;
+#else
+    LONG high=0; DWORD low=SetFilePointer(stream->h,0,&high,FILE_CURRENT);
+    return ((((ZPOS64_T)high)<<32)|low)-stream->initial_offset;
+#endif
+  }
   else if (stream->is_handle) return 0;
   else return stream->pos;
 }
 
-int lufseek(LUFILE *stream, long offset, int whence)
+int lufseek(LUFILE *stream, long long offset, int whence)
 { if (stream->is_handle && stream->canseek)
   {
 #ifdef ZIP_STD
-    return fseek(stream->h,stream->initial_offset+offset,whence);
+    return fseeko(stream->h,(off_t)(stream->initial_offset+offset),whence);
 #else
-    if (whence==SEEK_SET) SetFilePointer(stream->h,stream->initial_offset+offset,0,FILE_BEGIN);
-    else if (whence==SEEK_CUR) SetFilePointer(stream->h,offset,NULL,FILE_CURRENT);
-    else if (whence==SEEK_END) SetFilePointer(stream->h,offset,NULL,FILE_END);
+    LONG high;
+    if (whence==SEEK_SET) {offset+=stream->initial_offset; high=(LONG)(offset>>32); SetFilePointer(stream->h,(LONG)offset,&high,FILE_BEGIN);}
+    else if (whence==SEEK_CUR) {high=(LONG)(offset>>32); SetFilePointer(stream->h,(LONG)offset,&high,FILE_CURRENT);}
+    else if (whence==SEEK_END) {high=(LONG)(offset>>32); SetFilePointer(stream->h,(LONG)offset,&high,FILE_END);}
     else return 19; // EINVAL
     return 0;
 #endif
@@ -2841,7 +2915,8 @@ size_t lufread(void *ptr,size_t size,size_t n,LUFILE *stream)
     return red/size;
 #endif
   }
-  if (stream->pos+toread > stream->len) toread = stream->len-stream->pos;
+  if (stream->pos >= stream->len) toread = 0;
+  else if (stream->pos+toread > stream->len) toread = (unsigned int)(stream->len-stream->pos);
   memcpy(ptr, (char*)stream->buf + stream->pos, toread); DWORD red = toread;
   stream->pos += red;
   return red/size;
@@ -2857,20 +2932,20 @@ typedef struct
 	char  *read_buffer;         // internal buffer for compressed data
 	z_stream stream;            // zLib stream structure for inflate
 
-	uLong pos_in_zipfile;       // position in byte on the zipfile, for fseek
+	ZPOS64_T pos_in_zipfile;    // position in byte on the zipfile, for fseek
 	uLong stream_initialised;   // flag set if stream structure is initialised
 
-	uLong offset_local_extrafield;// offset of the local extra field
+	ZPOS64_T offset_local_extrafield;// offset of the local extra field
 	uInt  size_local_extrafield;// size of the local extra field
 	uLong pos_local_extrafield;   // position in the local extra field in read
 
 	uLong crc32;                // crc32 of all data uncompressed
 	uLong crc32_wait;           // crc32 we must obtain after decompress all
-	uLong rest_read_compressed; // number of byte to be decompressed
-	uLong rest_read_uncompressed;//number of byte to be obtained after decomp
+	ZPOS64_T rest_read_compressed; // number of byte to be decompressed
+	ZPOS64_T rest_read_uncompressed;//number of byte to be obtained after decomp
 	LUFILE* file;                 // io structore of the zipfile
 	uLong compression_method;   // compression method (0==store)
-	uLong byte_before_the_zipfile;// byte before the zipfile, (>0 for sfx)
+	ZPOS64_T byte_before_the_zipfile;// byte before the zipfile, (>0 for sfx)
   bool encrypted;               // is it encrypted?
   unsigned long keys[3];        // decryption keys, initialized by unzOpenCurrentFile
   int encheadleft;              // the first call(s) to unzReadCurrentFile will read this many encryption-header bytes first
@@ -2878,23 +2953,39 @@ typedef struct
 } file_in_zip_read_info_s;
 
 
+// unz_entry_s contain what the central directory says about one file, so that
+// any file can be reached without walking the central directory again
+typedef struct
+{
+	ZPOS64_T pos_in_central_dir; // pos of its header in the central dir
+	unz_file_info info;          // public info about it
+	unz_file_info_internal internal; // private info about it
+	uLong name_pos;              // pos of its name in unz_s::names
+} unz_entry_s;
+
+
 // unz_s contain internal information about the zipfile
 typedef struct
 {
 	LUFILE* file;               // io structore of the zipfile
 	unz_global_info gi;         // public global information
-	uLong byte_before_the_zipfile;// byte before the zipfile, (>0 for sfx)
+	ZPOS64_T byte_before_the_zipfile;// byte before the zipfile, (>0 for sfx)
 	uLong num_file;             // number of the current file in the zipfile
-	uLong pos_in_central_dir;   // pos of the current file in the central dir
+	ZPOS64_T pos_in_central_dir;// pos of the current file in the central dir
 	uLong current_file_ok;      // flag about the usability of the current file
-	uLong central_pos;          // position of the beginning of the central dir
+	ZPOS64_T central_pos;       // position of the beginning of the central dir
 
-	uLong size_central_dir;     // size of the central directory
-	uLong offset_central_dir;   // offset of start of central directory with respect to the starting disk number
+	ZPOS64_T size_central_dir;  // size of the central directory
+	ZPOS64_T offset_central_dir;// offset of start of central directory with respect to the starting disk number
 
 	unz_file_info cur_file_info; // public info about the current file in zip
 	unz_file_info_internal cur_file_info_internal; // private info about it
     file_in_zip_read_info_s* pfile_in_zip_read; // structure about the current file if we are decompressing it
+
+	unz_entry_s* entries;        // every file of the central directory, read once by unzOpenInternal
+	char* names;                 // their names, each one nul-terminated
+	uLong* name_table;           // hash table from a name to its file number+1 (0 for an empty slot)
+	uLong name_table_mask;       // size of name_table minus one, a power of two
 } unz_s, *unzFile;
 
 
@@ -2990,6 +3081,16 @@ int unzlocal_getLong (LUFILE *fin,uLong *pX)
     return err;
 }
 
+int unzlocal_getLong64 (LUFILE *fin,ZPOS64_T *pX)
+{
+    uLong lo=0, hi=0;
+    int err = unzlocal_getLong(fin,&lo);
+    if (err==UNZ_OK)
+        err = unzlocal_getLong(fin,&hi);
+    *pX = (err==UNZ_OK) ? ((((ZPOS64_T)hi)<<32) | lo) : 0;
+    return err;
+}
+
 
 // My own strcmpi / strcasecmp
 int strcmpcasenosensitive_internal (const char* fileName1,const char *fileName2)
@@ -3029,23 +3130,25 @@ int unzStringFileNameCompare (const char*fileName1,const char*fileName2,int iCas
 #define BUFREADCOMMENT (0x400)
 
 
+#define UNZ_NOTFOUND ((ZPOS64_T)-1)
+
 //  Locate the Central directory of a zipfile (at the end, just before
-// the global comment). Lu bugfix 2005.07.26 - returns 0xFFFFFFFF if not found,
+// the global comment). Lu bugfix 2005.07.26 - returns UNZ_NOTFOUND if not found,
 // rather than 0, since 0 is a valid central-dir-location for an empty zipfile.
-uLong unzlocal_SearchCentralDir(LUFILE *fin)
-{ if (lufseek(fin,0,SEEK_END) != 0) return 0xFFFFFFFF;
-  uLong uSizeFile = luftell(fin);
+ZPOS64_T unzlocal_SearchCentralDir(LUFILE *fin)
+{ if (lufseek(fin,0,SEEK_END) != 0) return UNZ_NOTFOUND;
+  ZPOS64_T uSizeFile = luftell(fin);
 
-  uLong uMaxBack=0xffff; // maximum size of global comment
+  ZPOS64_T uMaxBack=0xffff; // maximum size of global comment
   if (uMaxBack>uSizeFile) uMaxBack = uSizeFile;
 
   unsigned char *buf = (unsigned char*)zmalloc(BUFREADCOMMENT+4);
-  if (buf==NULL) return 0xFFFFFFFF;
-  uLong uPosFound=0xFFFFFFFF;
+  if (buf==NULL) return UNZ_NOTFOUND;
+  ZPOS64_T uPosFound=UNZ_NOTFOUND;
 
-  uLong uBackRead = 4;
+  ZPOS64_T uBackRead = 4;
   while (uBackRead<uMaxBack)
-  { uLong uReadSize,uReadPos ;
+  { ZPOS64_T uReadSize,uReadPos ;
     int i;
     if (uBackRead+BUFREADCOMMENT>uMaxBack) uBackRead = uMaxBack;
     else uBackRead+=BUFREADCOMMENT;
@@ -3058,15 +3161,32 @@ uLong unzlocal_SearchCentralDir(LUFILE *fin)
       { uPosFound = uReadPos+i;	break;
       }
     }
-    if (uPosFound!=0) break;
+    if (uPosFound!=UNZ_NOTFOUND) break;
   }
   if (buf) zfree(buf);
   return uPosFound;
 }
 
+//  Locate the Zip64 end of central directory record, from its locator just
+// before the end of central directory record at central_pos.
+// Returns UNZ_NOTFOUND if the zipfile has none.
+ZPOS64_T unzlocal_SearchCentralDir64(LUFILE *fin, ZPOS64_T central_pos)
+{ if (central_pos<20) return UNZ_NOTFOUND;
+  if (lufseek(fin,central_pos-20,SEEK_SET)!=0) return UNZ_NOTFOUND;
+  uLong uL=0; ZPOS64_T pos=0;
+  if (unzlocal_getLong(fin,&uL)!=UNZ_OK || uL!=0x07064b50) return UNZ_NOTFOUND;
+  if (unzlocal_getLong(fin,&uL)!=UNZ_OK) return UNZ_NOTFOUND; // disk with the zip64 end record
+  if (unzlocal_getLong64(fin,&pos)!=UNZ_OK) return UNZ_NOTFOUND;
+  if (lufseek(fin,pos,SEEK_SET)!=0) return UNZ_NOTFOUND;
+  if (unzlocal_getLong(fin,&uL)!=UNZ_OK || uL!=0x06064b50) return UNZ_NOTFOUND;
+  return pos;
+}
+
 
 int unzGoToFirstFile (unzFile file);
 int unzCloseCurrentFile (unzFile file);
+int unzlocal_ReadCentralDir (unz_s *s);
+void unzlocal_FreeCentralDir (unz_s *s);
 
 // Open a Zip file.
 // If the zipfile cannot be opened (file don't exist or in not valid), return NULL.
@@ -3076,10 +3196,10 @@ unzFile unzOpenInternal(LUFILE *fin)
   if (unz_copyright[0]!=' ') {lufclose(fin); return NULL;}
 
   int err=UNZ_OK;
-  unz_s us={0};
-  uLong central_pos=0,uL=0;
+  unz_s us={};
+  ZPOS64_T central_pos=0; uLong uL=0;
   central_pos = unzlocal_SearchCentralDir(fin);
-  if (central_pos==0xFFFFFFFF) err=UNZ_ERRNO;
+  if (central_pos==UNZ_NOTFOUND) err=UNZ_ERRNO;
   if (err==UNZ_OK && lufseek(fin,central_pos,SEEK_SET)!=0) err=UNZ_ERRNO;
   // the signature, already checked
   if (err==UNZ_OK && unzlocal_getLong(fin,&uL)!=UNZ_OK) err=UNZ_ERRNO;
@@ -3096,11 +3216,30 @@ unzFile unzOpenInternal(LUFILE *fin)
   if (err==UNZ_OK && unzlocal_getShort(fin,&number_entry_CD)!=UNZ_OK) err=UNZ_ERRNO;
   if (err==UNZ_OK && ((number_entry_CD!=us.gi.number_entry) || (number_disk_with_CD!=0) || (number_disk!=0))) err=UNZ_BADZIPFILE;
   // size of the central directory
-  if (err==UNZ_OK && unzlocal_getLong(fin,&us.size_central_dir)!=UNZ_OK) err=UNZ_ERRNO;
+  if (err==UNZ_OK && unzlocal_getLong(fin,&uL)!=UNZ_OK) err=UNZ_ERRNO;
+  us.size_central_dir = uL;
   // offset of start of central directory with respect to the starting disk number
-  if (err==UNZ_OK && unzlocal_getLong(fin,&us.offset_central_dir)!=UNZ_OK) err=UNZ_ERRNO;
+  if (err==UNZ_OK && unzlocal_getLong(fin,&uL)!=UNZ_OK) err=UNZ_ERRNO;
+  us.offset_central_dir = uL;
   // zipfile comment length
   if (err==UNZ_OK && unzlocal_getShort(fin,&us.gi.size_comment)!=UNZ_OK) err=UNZ_ERRNO;
+  // Zip64: the real values are in the Zip64 end of central directory record,
+  // and the central directory ends where that record starts
+  ZPOS64_T central64_pos = (err==UNZ_OK) ? unzlocal_SearchCentralDir64(fin,central_pos) : UNZ_NOTFOUND;
+  if (central64_pos!=UNZ_NOTFOUND)
+  { ZPOS64_T uL64=0;
+    // size of the record (8), version made by (2), version needed (2), number of this disk (4)
+    if (err==UNZ_OK && lufseek(fin,central64_pos+4+8+2+2,SEEK_SET)!=0) err=UNZ_ERRNO;
+    if (err==UNZ_OK && unzlocal_getLong(fin,&number_disk)!=UNZ_OK) err=UNZ_ERRNO;
+    if (err==UNZ_OK && unzlocal_getLong(fin,&number_disk_with_CD)!=UNZ_OK) err=UNZ_ERRNO;
+    if (err==UNZ_OK && unzlocal_getLong64(fin,&uL64)!=UNZ_OK) err=UNZ_ERRNO;
+    us.gi.number_entry = (unsigned long)uL64;
+    if (err==UNZ_OK && unzlocal_getLong64(fin,&uL64)!=UNZ_OK) err=UNZ_ERRNO;
+    if (err==UNZ_OK && ((uL64!=us.gi.number_entry) || (number_disk_with_CD!=0) || (number_disk!=0))) err=UNZ_BADZIPFILE;
+    if (err==UNZ_OK && unzlocal_getLong64(fin,&us.size_central_dir)!=UNZ_OK) err=UNZ_ERRNO;
+    if (err==UNZ_OK && unzlocal_getLong64(fin,&us.offset_central_dir)!=UNZ_OK) err=UNZ_ERRNO;
+    central_pos = central64_pos;
+  }
   if (err==UNZ_OK && ((central_pos+fin->initial_offset<us.offset_central_dir+us.size_central_dir) && (err==UNZ_OK))) err=UNZ_BADZIPFILE;
   if (err!=UNZ_OK) {lufclose(fin);return NULL;}
 
@@ -3112,6 +3251,7 @@ unzFile unzOpenInternal(LUFILE *fin)
 
   unz_s *s = (unz_s*)zmalloc(sizeof(unz_s));
   *s=us;
+  if (unzlocal_ReadCentralDir(s)!=UNZ_OK) {lufclose(fin); zfree(s); return NULL;}
   unzGoToFirstFile((unzFile)s);
   return (unzFile)s;
 }
@@ -3133,6 +3273,7 @@ int unzClose (unzFile file)
         unzCloseCurrentFile(file);
 
 	lufclose(s->file);
+	unzlocal_FreeCentralDir(s);
 	if (s) zfree(s); // unused s=0;
 	return UNZ_OK;
 }
@@ -3187,7 +3328,7 @@ int unzlocal_GetCurrentFileInfoInternal (unzFile file, unz_file_info *pfile_info
 	unz_file_info file_info;
 	unz_file_info_internal file_info_internal;
 	int err=UNZ_OK;
-	uLong uMagic;
+	uLong uMagic, uL=0;
 	long lSeek=0;
 
 	if (file==NULL)
@@ -3224,11 +3365,13 @@ int unzlocal_GetCurrentFileInfoInternal (unzFile file, unz_file_info *pfile_info
 	if (unzlocal_getLong(s->file,&file_info.crc) != UNZ_OK)
 		err=UNZ_ERRNO;
 
-	if (unzlocal_getLong(s->file,&file_info.compressed_size) != UNZ_OK)
+	if (unzlocal_getLong(s->file,&uL) != UNZ_OK)
 		err=UNZ_ERRNO;
+	file_info.compressed_size = uL;
 
-	if (unzlocal_getLong(s->file,&file_info.uncompressed_size) != UNZ_OK)
+	if (unzlocal_getLong(s->file,&uL) != UNZ_OK)
 		err=UNZ_ERRNO;
+	file_info.uncompressed_size = uL;
 
 	if (unzlocal_getShort(s->file,&file_info.size_filename) != UNZ_OK)
 		err=UNZ_ERRNO;
@@ -3248,8 +3391,9 @@ int unzlocal_GetCurrentFileInfoInternal (unzFile file, unz_file_info *pfile_info
 	if (unzlocal_getLong(s->file,&file_info.external_fa) != UNZ_OK)
 		err=UNZ_ERRNO;
 
-	if (unzlocal_getLong(s->file,&file_info_internal.offset_curfile) != UNZ_OK)
+	if (unzlocal_getLong(s->file,&uL) != UNZ_OK)
 		err=UNZ_ERRNO;
+	file_info_internal.offset_curfile = uL;
 
 	lSeek+=file_info.size_filename;
 	if ((err==UNZ_OK) && (szFileName!=NULL))
@@ -3315,6 +3459,34 @@ int unzlocal_GetCurrentFileInfoInternal (unzFile file, unz_file_info *pfile_info
 	}
 	else {} //unused lSeek+=file_info.size_file_comment;
 
+	// Zip64: the sizes and the offset that don't fit in 4 bytes are in the Zip64 extra field
+	if ((err==UNZ_OK) && (file_info.size_file_extra>0) &&
+	    (file_info.uncompressed_size==0xFFFFFFFF || file_info.compressed_size==0xFFFFFFFF ||
+	     file_info_internal.offset_curfile==0xFFFFFFFF))
+	{
+		uLong epos=0, eid=0, esize=0;
+		if (lufseek(s->file,s->pos_in_central_dir+s->byte_before_the_zipfile+SIZECENTRALDIRITEM+file_info.size_filename,SEEK_SET)!=0)
+			err=UNZ_ERRNO;
+		while ((err==UNZ_OK) && (epos+4<=file_info.size_file_extra))
+		{
+			if (unzlocal_getShort(s->file,&eid)!=UNZ_OK || unzlocal_getShort(s->file,&esize)!=UNZ_OK)
+				{err=UNZ_ERRNO; break;}
+			if (eid==0x0001)
+			{
+				if (file_info.uncompressed_size==0xFFFFFFFF && unzlocal_getLong64(s->file,&file_info.uncompressed_size)!=UNZ_OK)
+					err=UNZ_ERRNO;
+				if (file_info.compressed_size==0xFFFFFFFF && unzlocal_getLong64(s->file,&file_info.compressed_size)!=UNZ_OK)
+					err=UNZ_ERRNO;
+				if (file_info_internal.offset_curfile==0xFFFFFFFF && unzlocal_getLong64(s->file,&file_info_internal.offset_curfile)!=UNZ_OK)
+					err=UNZ_ERRNO;
+				break;
+			}
+			epos += 4+esize;
+			if (lufseek(s->file,esize,SEEK_CUR)!=0)
+				err=UNZ_ERRNO;
+		}
+	}
+
 	if ((err==UNZ_OK) && (pfile_info!=NULL))
 		*pfile_info=file_info;
 
@@ -3337,21 +3509,140 @@ int unzGetCurrentFileInfo (unzFile file, unz_file_info *pfile_info,
 }
 
 
+//  Hash of a filename, the same whatever the case of its letters, so that
+//    it serves both kinds of comparison of unzStringFileNameCompare (FNV-1a)
+uLong unzlocal_NameHash (const char *szFileName)
+{
+	uLong h=2166136261UL;
+	for (const char *c=szFileName; *c!=0; c++)
+	{
+		char ch=*c;
+		if ((ch>='a') && (ch<='z'))
+			ch -= (char)0x20;
+		h = ((h^(unsigned char)ch)*16777619UL)&0xffffffffUL;
+	}
+	return h;
+}
+
+
+//  Read the whole central directory once, into s->entries, and index the
+//    names of the files in s->name_table. The headers are parsed from a copy
+//    of the central directory in memory, by the usual routines.
+//  return UNZ_OK if there is no problem
+int unzlocal_ReadCentralDir (unz_s *s)
+{
+	uLong n = s->gi.number_entry;
+	if (n==0)
+		return UNZ_OK;
+	if (s->size_central_dir>0xffffffffUL || n>s->size_central_dir/SIZECENTRALDIRITEM)
+		return UNZ_BADZIPFILE;
+
+	int err=UNZ_OK;
+	uInt len = (uInt)s->size_central_dir;
+	char *buf = (char*)zmalloc(len);
+	s->entries = (unz_entry_s*)zmalloc(n*sizeof(unz_entry_s));
+	s->names = (char*)zmalloc(len+n);
+	for (s->name_table_mask=1; s->name_table_mask<2*n; s->name_table_mask<<=1) {}
+	s->name_table = (uLong*)zmalloc(s->name_table_mask*sizeof(uLong));
+	s->name_table_mask--;
+	if (buf==NULL || s->entries==NULL || s->names==NULL || s->name_table==NULL)
+		err=UNZ_INTERNALERROR;
+	if (err==UNZ_OK)
+		memset(s->name_table,0,(s->name_table_mask+1)*sizeof(uLong));
+
+	if (err==UNZ_OK && lufseek(s->file,s->offset_central_dir+s->byte_before_the_zipfile,SEEK_SET)!=0)
+		err=UNZ_ERRNO;
+	if (err==UNZ_OK && lufread(buf,len,1,s->file)!=1)
+		err=UNZ_ERRNO;
+
+	ZRESULT zerr; unz_s cd = *s;
+	cd.file = (err==UNZ_OK) ? lufopen(buf,len,ZIP_MEMORY,&zerr) : NULL;
+	cd.byte_before_the_zipfile = 0;
+	cd.pos_in_central_dir = 0;
+	if (err==UNZ_OK && cd.file==NULL)
+		err=UNZ_INTERNALERROR;
+
+	uLong name_pos=0;
+	for (uLong i=0; (err==UNZ_OK) && (i<n); i++)
+	{
+		unz_entry_s *e = &s->entries[i];
+		err = unzlocal_GetCurrentFileInfoInternal((unzFile)&cd,&e->info,&e->internal,NULL,0,NULL,0,NULL,0);
+		if ((err==UNZ_OK) && (cd.pos_in_central_dir+SIZECENTRALDIRITEM+e->info.size_filename+
+		                      e->info.size_file_extra+e->info.size_file_comment>len))
+			err=UNZ_BADZIPFILE;
+		if (err!=UNZ_OK)
+			break;
+
+		e->pos_in_central_dir = s->offset_central_dir+cd.pos_in_central_dir;
+		e->name_pos = name_pos;
+		memcpy(s->names+name_pos,buf+cd.pos_in_central_dir+SIZECENTRALDIRITEM,e->info.size_filename);
+		s->names[name_pos+e->info.size_filename]='\0';
+		name_pos += e->info.size_filename+1;
+
+		// linear probing keeps the files with the same name in their order,
+		// so unzLocateFile finds the first one, like a walk would
+		uLong h = unzlocal_NameHash(s->names+e->name_pos)&s->name_table_mask;
+		while (s->name_table[h]!=0)
+			h = (h+1)&s->name_table_mask;
+		s->name_table[h] = i+1;
+
+		cd.pos_in_central_dir += SIZECENTRALDIRITEM + e->info.size_filename +
+				e->info.size_file_extra + e->info.size_file_comment;
+	}
+
+	if (cd.file!=NULL)
+		lufclose(cd.file);
+	if (buf!=NULL)
+		zfree(buf);
+	if (err!=UNZ_OK)
+		unzlocal_FreeCentralDir(s);
+	return err;
+}
+
+
+void unzlocal_FreeCentralDir (unz_s *s)
+{
+	if (s->entries!=NULL) zfree(s->entries);
+	if (s->names!=NULL) zfree(s->names);
+	if (s->name_table!=NULL) zfree(s->name_table);
+	s->entries=NULL; s->names=NULL; s->name_table=NULL; s->name_table_mask=0;
+}
+
+
+//  Set the current file of the zipfile to the file number num, straight from
+//    the entries read by unzOpenInternal
+//  return UNZ_OK if there is no problem
+//  return UNZ_END_OF_LIST_OF_FILE if there is no such file
+int unzGoToFile (unzFile file, uLong num)
+{
+	unz_s* s;
+	if (file==NULL)
+		return UNZ_PARAMERROR;
+	s=(unz_s*)file;
+	if (num>=s->gi.number_entry)
+		return UNZ_END_OF_LIST_OF_FILE;
+
+	const unz_entry_s *e = &s->entries[num];
+	s->num_file = num;
+	s->pos_in_central_dir = e->pos_in_central_dir;
+	s->cur_file_info = e->info;
+	s->cur_file_info_internal = e->internal;
+	s->current_file_ok = 1;
+	return UNZ_OK;
+}
+
+
 //  Set the current file of the zipfile to the first file.
 //  return UNZ_OK if there is no problem
 int unzGoToFirstFile (unzFile file)
 {
-	int err;
 	unz_s* s;
 	if (file==NULL) return UNZ_PARAMERROR;
 	s=(unz_s*)file;
 	s->pos_in_central_dir=s->offset_central_dir;
 	s->num_file=0;
-	err=unzlocal_GetCurrentFileInfoInternal(file,&s->cur_file_info,
-											 &s->cur_file_info_internal,
-											 NULL,0,NULL,0,NULL,0);
-	s->current_file_ok = (err == UNZ_OK);
-	return err;
+	s->current_file_ok = 0;
+	return unzGoToFile(file,0);
 }
 
 
@@ -3361,24 +3652,13 @@ int unzGoToFirstFile (unzFile file)
 int unzGoToNextFile (unzFile file)
 {
 	unz_s* s;
-	int err;
 
 	if (file==NULL)
 		return UNZ_PARAMERROR;
 	s=(unz_s*)file;
 	if (!s->current_file_ok)
 		return UNZ_END_OF_LIST_OF_FILE;
-	if (s->num_file+1==s->gi.number_entry)
-		return UNZ_END_OF_LIST_OF_FILE;
-
-	s->pos_in_central_dir += SIZECENTRALDIRITEM + s->cur_file_info.size_filename +
-			s->cur_file_info.size_file_extra + s->cur_file_info.size_file_comment ;
-	s->num_file++;
-	err = unzlocal_GetCurrentFileInfoInternal(file,&s->cur_file_info,
-											   &s->cur_file_info_internal,
-											   NULL,0,NULL,0,NULL,0);
-	s->current_file_ok = (err == UNZ_OK);
-	return err;
+	return unzGoToFile(file,s->num_file+1);
 }
 
 
@@ -3390,12 +3670,6 @@ int unzGoToNextFile (unzFile file)
 int unzLocateFile (unzFile file, const char *szFileName, int iCaseSensitivity)
 {
 	unz_s* s;
-	int err;
-
-
-	uLong num_fileSaved;
-	uLong pos_in_central_dirSaved;
-
 
 	if (file==NULL)
 		return UNZ_PARAMERROR;
@@ -3404,28 +3678,17 @@ int unzLocateFile (unzFile file, const char *szFileName, int iCaseSensitivity)
         return UNZ_PARAMERROR;
 
 	s=(unz_s*)file;
-	if (!s->current_file_ok)
+	if (!s->current_file_ok || s->name_table==NULL)
 		return UNZ_END_OF_LIST_OF_FILE;
 
-	num_fileSaved = s->num_file;
-	pos_in_central_dirSaved = s->pos_in_central_dir;
-
-	err = unzGoToFirstFile(file);
-
-	while (err == UNZ_OK)
+	uLong h = unzlocal_NameHash(szFileName)&s->name_table_mask;
+	for (uLong i=s->name_table[h]; i!=0; i=s->name_table[h])
 	{
-		char szCurrentFileName[UNZ_MAXFILENAMEINZIP+1];
-		unzGetCurrentFileInfo(file,NULL,
-								szCurrentFileName,sizeof(szCurrentFileName)-1,
-								NULL,0,NULL,0);
-		if (unzStringFileNameCompare(szCurrentFileName,szFileName,iCaseSensitivity)==0)
-			return UNZ_OK;
-		err = unzGoToNextFile(file);
+		if (unzStringFileNameCompare(s->names+s->entries[i-1].name_pos,szFileName,iCaseSensitivity)==0)
+			return unzGoToFile(file,i-1);
+		h = (h+1)&s->name_table_mask;
 	}
-
-	s->num_file = num_fileSaved ;
-	s->pos_in_central_dir = pos_in_central_dirSaved ;
-	return err;
+	return UNZ_END_OF_LIST_OF_FILE;
 }
 
 
@@ -3435,7 +3698,7 @@ int unzLocateFile (unzFile file, const char *szFileName, int iCaseSensitivity)
 //  store in *piSizeVar the size of extra info in local header
 //        (filename and size of extra field data)
 int unzlocal_CheckCurrentFileCoherencyHeader (unz_s *s,uInt *piSizeVar,
-  uLong *poffset_local_extrafield, uInt  *psize_local_extrafield)
+  ZPOS64_T *poffset_local_extrafield, uInt  *psize_local_extrafield)
 {
 	uLong uMagic,uData,uFlags;
 	uLong size_filename;
@@ -3481,16 +3744,17 @@ int unzlocal_CheckCurrentFileCoherencyHeader (unz_s *s,uInt *piSizeVar,
 		                      ((uFlags & 8)==0))
 		err=UNZ_BADZIPFILE;
 
+	// (0xFFFFFFFF means that the size is in the Zip64 extra field)
 	if (unzlocal_getLong(s->file,&uData) != UNZ_OK) // size compr
 		err=UNZ_ERRNO;
 	else if ((err==UNZ_OK) && (uData!=s->cur_file_info.compressed_size) &&
-							  ((uFlags & 8)==0))
+							  (uData!=0xFFFFFFFF) && ((uFlags & 8)==0))
 		err=UNZ_BADZIPFILE;
 
 	if (unzlocal_getLong(s->file,&uData) != UNZ_OK) // size uncompr
 		err=UNZ_ERRNO;
 	else if ((err==UNZ_OK) && (uData!=s->cur_file_info.uncompressed_size) &&
-							  ((uFlags & 8)==0))
+							  (uData!=0xFFFFFFFF) && ((uFlags & 8)==0))
 		err=UNZ_BADZIPFILE;
 
 
@@ -3525,7 +3789,7 @@ int unzOpenCurrentFile (unzFile file, const char *password)
 	uInt iSizeVar;
 	unz_s* s;
 	file_in_zip_read_info_s* pfile_in_zip_read_info;
-	uLong offset_local_extrafield;  // offset of the local extra field
+	ZPOS64_T offset_local_extrafield;  // offset of the local extra field
 	uInt  size_local_extrafield;    // size of the local extra field
 
 	if (file==NULL)
@@ -3640,14 +3904,24 @@ int unzReadCurrentFile  (unzFile file, voidp buf, unsigned len, bool *reached_eo
 
   while (pfile_in_zip_read_info->stream.avail_out>0)
   { if ((pfile_in_zip_read_info->stream.avail_in==0) && (pfile_in_zip_read_info->rest_read_compressed>0))
-    { uInt uReadThis = UNZ_BUFSIZE;
+    { LUFILE *f = pfile_in_zip_read_info->file;
+      // a memory block or a mapped file is read in place (unless it must be decrypted)
+      bool inplace = !f->is_handle && !pfile_in_zip_read_info->encrypted;
+      uInt uReadThis = inplace ? 0x40000000 : UNZ_BUFSIZE;
       if (pfile_in_zip_read_info->rest_read_compressed<uReadThis) uReadThis = (uInt)pfile_in_zip_read_info->rest_read_compressed;
       if (uReadThis == 0) {if (reached_eof!=0) *reached_eof=true; return UNZ_EOF;}
-      if (lufseek(pfile_in_zip_read_info->file, pfile_in_zip_read_info->pos_in_zipfile + pfile_in_zip_read_info->byte_before_the_zipfile,SEEK_SET)!=0) return UNZ_ERRNO;
-      if (lufread(pfile_in_zip_read_info->read_buffer,uReadThis,1,pfile_in_zip_read_info->file)!=1) return UNZ_ERRNO;
+      ZPOS64_T pos = pfile_in_zip_read_info->pos_in_zipfile + pfile_in_zip_read_info->byte_before_the_zipfile;
+      if (inplace)
+      { if (pos>f->len || uReadThis>f->len-pos) return UNZ_ERRNO;
+        pfile_in_zip_read_info->stream.next_in = (Byte*)f->buf + pos;
+      }
+      else
+      { if (lufseek(f,pos,SEEK_SET)!=0) return UNZ_ERRNO;
+        if (lufread(pfile_in_zip_read_info->read_buffer,uReadThis,1,f)!=1) return UNZ_ERRNO;
+        pfile_in_zip_read_info->stream.next_in = (Byte*)pfile_in_zip_read_info->read_buffer;
+      }
       pfile_in_zip_read_info->pos_in_zipfile += uReadThis;
       pfile_in_zip_read_info->rest_read_compressed-=uReadThis;
-      pfile_in_zip_read_info->stream.next_in = (Byte*)pfile_in_zip_read_info->read_buffer;
       pfile_in_zip_read_info->stream.avail_in = (uInt)uReadThis;
       //
       if (pfile_in_zip_read_info->encrypted)
@@ -3670,14 +3944,14 @@ int unzReadCurrentFile  (unzFile file, voidp buf, unsigned len, bool *reached_eo
     }
 
     if (pfile_in_zip_read_info->compression_method==0)
-    { uInt uDoCopy,i ;
+    { uInt uDoCopy;
       if (pfile_in_zip_read_info->stream.avail_out < pfile_in_zip_read_info->stream.avail_in)
       { uDoCopy = pfile_in_zip_read_info->stream.avail_out ;
       }
       else
       { uDoCopy = pfile_in_zip_read_info->stream.avail_in ;
       }
-      for (i=0;i<uDoCopy;i++) *(pfile_in_zip_read_info->stream.next_out+i) = *(pfile_in_zip_read_info->stream.next_in+i);
+      memcpy(pfile_in_zip_read_info->stream.next_out,pfile_in_zip_read_info->stream.next_in,uDoCopy);
       pfile_in_zip_read_info->crc32 = ucrc32(pfile_in_zip_read_info->crc32,pfile_in_zip_read_info->stream.next_out,uDoCopy);
       pfile_in_zip_read_info->rest_read_uncompressed-=uDoCopy;
       pfile_in_zip_read_info->stream.avail_in -= uDoCopy;
@@ -3885,6 +4159,8 @@ class TUnzip
   ZRESULT Get(int index,ZIPENTRY *ze);
   ZRESULT Find(const TCHAR *name,bool ic,int *index,ZIPENTRY *ze);
   ZRESULT Unzip(int index,void *dst,unsigned int len,DWORD flags);
+  ZRESULT View(int index,const void **data,long long *len);
+  ZRESULT Raw(int index,ZIPRAWITEM *raw);
   ZRESULT SetUnzipBaseDir(const TCHAR *dir);
   ZRESULT Close();
 };
@@ -3946,13 +4222,12 @@ ZRESULT TUnzip::Get(int index,ZIPENTRY *ze)
     ze->unc_size=0;
     return ZR_OK;
   }
-  if (index<(int)uf->num_file) unzGoToFirstFile(uf);
-  while ((int)uf->num_file<index) unzGoToNextFile(uf);
-  unz_file_info ufi; char fn[MAX_PATH];
-  unzGetCurrentFileInfo(uf,&ufi,fn,MAX_PATH,NULL,0,NULL,0);
+  if (unzGoToFile(uf,index)!=UNZ_OK) return ZR_ARGS;
+  unz_file_info ufi=uf->cur_file_info; char fn[MAX_PATH];
+  strncpy(fn,uf->names+uf->entries[index].name_pos,MAX_PATH-1); fn[MAX_PATH-1]=0;
   // now get the extra header. We do this ourselves, instead of
   // calling unzOpenCurrentFile &c., to avoid allocating more than necessary.
-  unsigned int extralen,iSizeVar; unsigned long offset;
+  unsigned int extralen,iSizeVar; ZPOS64_T offset;
   int res = unzlocal_CheckCurrentFileCoherencyHeader(uf,&iSizeVar,&offset,&extralen);
   if (res!=UNZ_OK) return ZR_CORRUPT;
   if (lufseek(uf->file,offset,SEEK_SET)!=0) return ZR_READ;
@@ -4123,9 +4398,7 @@ ZRESULT TUnzip::Unzip(int index,void *dst,unsigned int len,DWORD flags)
   if (flags==ZIP_MEMORY)
   { if (index!=currentfile)
     { if (currentfile!=-1) unzCloseCurrentFile(uf); currentfile=-1;
-      if (index>=(int)uf->gi.number_entry) return ZR_ARGS;
-      if (index<(int)uf->num_file) unzGoToFirstFile(uf);
-      while ((int)uf->num_file<index) unzGoToNextFile(uf);
+      if (index<0 || unzGoToFile(uf,index)!=UNZ_OK) return ZR_ARGS;
       unzOpenCurrentFile(uf,password); currentfile=index;
     }
     bool reached_eof;
@@ -4138,9 +4411,7 @@ ZRESULT TUnzip::Unzip(int index,void *dst,unsigned int len,DWORD flags)
   }
   // otherwise we're writing to a handle or a file
   if (currentfile!=-1) unzCloseCurrentFile(uf); currentfile=-1;
-  if (index>=(int)uf->gi.number_entry) return ZR_ARGS;
-  if (index<(int)uf->num_file) unzGoToFirstFile(uf);
-  while ((int)uf->num_file<index) unzGoToNextFile(uf);
+  if (index<0 || unzGoToFile(uf,index)!=UNZ_OK) return ZR_ARGS;
   ZIPENTRY ze; Get(index,&ze);
   // zipentry=directory is handled specially
 #ifdef ZIP_STD
@@ -4180,13 +4451,26 @@ ZRESULT TUnzip::Unzip(int index,void *dst,unsigned int len,DWORD flags)
 #endif
   }
   if (h==INVALID_HANDLE_VALUE) return ZR_NOFILE;
-  unzOpenCurrentFile(uf,password);
-  if (unzbuf==0) unzbuf=new char[16384]; DWORD haderr=0;
+  DWORD haderr=0;
+  const void *view; long long viewlen;
+  bool inplace = (View(index,&view,&viewlen)==ZR_OK);
+  if (!inplace) unzOpenCurrentFile(uf,password);
+  if (!inplace && unzbuf==0) unzbuf=new char[UNZ_BUFSIZE];
   //
 
-  for (; haderr==0;)
+  while (inplace && viewlen>0)
+  { // a stored item of a memory block or a mapped file is written as it is
+    unsigned int chunk = viewlen>0x40000000 ? 0x40000000 : (unsigned int)viewlen;
+#ifdef ZIP_STD
+    size_t writ=fwrite(view,1,chunk,h); if (writ<(size_t)chunk) {haderr=ZR_WRITE; break;}
+#else
+    DWORD writ; BOOL bres=WriteFile(h,view,chunk,&writ,NULL); if (!bres) {haderr=ZR_WRITE; break;}
+#endif
+    view=(const char*)view+chunk; viewlen-=chunk;
+  }
+  for (; !inplace && haderr==0;)
   { bool reached_eof;
-    int res = unzReadCurrentFile(uf,unzbuf,16384,&reached_eof);
+    int res = unzReadCurrentFile(uf,unzbuf,UNZ_BUFSIZE,&reached_eof);
     if (res==UNZ_PASSWORD) {haderr=ZR_PASSWORD; break;}
     if (res<0) {haderr=ZR_FLATE; break;}
 #ifdef ZIP_STD
@@ -4197,7 +4481,7 @@ ZRESULT TUnzip::Unzip(int index,void *dst,unsigned int len,DWORD flags)
     if (reached_eof) break;
     if (res==0) {haderr=ZR_FLATE; break;}
   }
-  unzCloseCurrentFile(uf);
+  if (!inplace) unzCloseCurrentFile(uf);
 #ifdef ZIP_STD
   if (flags!=ZIP_HANDLE) fclose(h);
   if (*fn!=0) {struct utimbuf ubuf; ubuf.actime=ze.atime; ubuf.modtime=ze.mtime; utime(fn,&ubuf);}
@@ -4209,6 +4493,32 @@ ZRESULT TUnzip::Unzip(int index,void *dst,unsigned int len,DWORD flags)
   return ZR_OK;
 }
 
+ZRESULT TUnzip::View(int index,const void **data,long long *len)
+{ ZIPRAWITEM raw; ZRESULT res=Raw(index,&raw);
+  if (res!=ZR_OK) return res;
+  if (raw.method!=0 || raw.comp_size!=raw.unc_size) return ZR_NOTMMAP;
+  *data = raw.data; *len = raw.unc_size;
+  return ZR_OK;
+}
+
+ZRESULT TUnzip::Raw(int index,ZIPRAWITEM *raw)
+{ if (currentfile!=-1) unzCloseCurrentFile(uf); currentfile=-1;
+  if (index<0 || unzGoToFile(uf,index)!=UNZ_OK) return ZR_ARGS;
+  // only the items of a memory block or a mapped file are there as they are
+  LUFILE *f = uf->file;
+  int method = uf->cur_file_info.compression_method;
+  if (f->is_handle || (method!=0 && method!=Z_DEFLATED) || (uf->cur_file_info.flag&1)!=0) return ZR_NOTMMAP;
+  uInt iSizeVar, extralen; ZPOS64_T extrapos;
+  if (unzlocal_CheckCurrentFileCoherencyHeader(uf,&iSizeVar,&extrapos,&extralen)!=UNZ_OK) return ZR_CORRUPT;
+  ZPOS64_T pos = uf->cur_file_info_internal.offset_curfile + SIZEZIPLOCALHEADER + iSizeVar + uf->byte_before_the_zipfile;
+  ZPOS64_T size = uf->cur_file_info.compressed_size;
+  if (pos>f->len || size>f->len-pos) return ZR_CORRUPT;
+  raw->method = method; raw->crc = uf->cur_file_info.crc;
+  raw->data = (const char*)f->buf + pos; raw->comp_size = (long long)size;
+  raw->unc_size = (long long)uf->cur_file_info.uncompressed_size;
+  return ZR_OK;
+}
+
 ZRESULT TUnzip::Close()
 { if (currentfile!=-1) unzCloseCurrentFile(uf); currentfile=-1;
   if (uf!=0) unzClose(uf); uf=0;
@@ -4219,7 +4529,7 @@ ZRESULT TUnzip::Close()
 
 
 
-ZRESULT lasterrorU=ZR_OK;
+thread_local ZRESULT lasterrorU=ZR_OK; // per thread, as several unzips can run at once
 
 unsigned int FormatZipMessageU(ZRESULT code, TCHAR *buf,unsigned int len)
 { if (code==ZR_RECENT) code=lasterrorU;
@@ -4271,6 +4581,7 @@ HZIP OpenZipInternal(void *z,unsigned int len,DWORD flags, const char *password)
 HZIP OpenZipHandle(HANDLE h, const char *password) {return OpenZipInternal((void*)h,0,ZIP_HANDLE,password);}
 HZIP OpenZip(const TCHAR *fn, const char *password) {return OpenZipInternal((void*)fn,0,ZIP_FILENAME,password);}
 HZIP OpenZip(void *z,unsigned int len, const char *password) {return OpenZipInternal(z,len,ZIP_MEMORY,password);}
+HZIP OpenZipMapped(const TCHAR *fn, const char *password) {return OpenZipInternal((void*)fn,0,ZIP_MAPPED,password);}
 
 
 ZRESULT GetZipItem(HZIP hz, int index, ZIPENTRY *ze)
@@ -4304,6 +4615,41 @@ ZRESULT UnzipItemHandle(HZIP hz, int index, HANDLE h) {return UnzipItemInternal(
 ZRESULT UnzipItem(HZIP hz, int index, const TCHAR *fn) {return UnzipItemInternal(hz,index,(void*)fn,0,ZIP_FILENAME);}
 ZRESULT UnzipItem(HZIP hz, int index, void *z,unsigned int len) {return UnzipItemInternal(hz,index,z,len,ZIP_MEMORY);}
 
+ZRESULT GetZipItemView(HZIP hz, int index, const void **data, long long *len)
+{ if (hz==0 || data==0 || len==0) {lasterrorU=ZR_ARGS;return ZR_ARGS;}
+  TUnzipHandleData *han = (TUnzipHandleData*)hz;
+  if (han->flag!=1) {lasterrorU=ZR_ZMODE;return ZR_ZMODE;}
+  TUnzip *unz = han->unz;
+  lasterrorU = unz->View(index,data,len);
+  return lasterrorU;
+}
+
+ZRESULT GetZipItemRaw(HZIP hz, int index, ZIPRAWITEM *raw)
+{ if (hz==0 || raw==0) {lasterrorU=ZR_ARGS;return ZR_ARGS;}
+  TUnzipHandleData *han = (TUnzipHandleData*)hz;
+  if (han->flag!=1) {lasterrorU=ZR_ZMODE;return ZR_ZMODE;}
+  TUnzip *unz = han->unz;
+  lasterrorU = unz->Raw(index,raw);
+  return lasterrorU;
+}
+
+ZRESULT UnzipZlibBuffer(const void *src, unsigned int srclen, void *dst, unsigned int *dstlen)
+{ if (src==0 || dst==0 || dstlen==0) return ZR_ARGS;
+  z_stream zs; memset(&zs,0,sizeof(zs));
+  if (inflateInitW(&zs,15)!=Z_OK) return ZR_NOTINITED;
+  zs.next_in=(Byte*)src; zs.avail_in=srclen;
+  zs.next_out=(Byte*)dst; zs.avail_out=*dstlen;
+  int code=Z_OK;
+  while (code==Z_OK && zs.avail_out>0) code=inflate(&zs,Z_SYNC_FLUSH);
+  // the output buffer is full, but the stream may just be missing its adler32 check
+  if (code==Z_OK) code=inflate(&zs,Z_SYNC_FLUSH);
+  *dstlen=(unsigned int)zs.total_out;
+  inflateEnd(&zs);
+  if (code==Z_STREAM_END) return ZR_OK;
+  if (code==Z_OK || (code==Z_BUF_ERROR && zs.avail_out==0)) return ZR_MEMSIZE;
+  return ZR_FLATE;
+}
+
 ZRESULT SetUnzipBaseDir(HZIP hz, const TCHAR *dir)
 { if (hz==0) {lasterrorU=ZR_ARGS;return ZR_ARGS;}
   TUnzipHandleData *han = (TUnzipHandleData*)hz;
@@ -36,14 +36,16 @@ typedef struct
   TCHAR name[MAX_PATH];      // filename within the zip
   DWORD attr;                // attributes, as in GetFileAttributes.
   FILETIME atime,ctime,mtime;// access, create, modify filetimes
-  long comp_size;            // sizes of item, compressed and uncompressed. These
-  long unc_size;             // may be -1 if not yet known (e.g. being streamed in)
+  long long comp_size;       // sizes of item, compressed and uncompressed. These
+  long long unc_size;        // may be -1 if not yet known (e.g. being streamed in).
+                             // Sizes over 4GB come from the Zip64 extra field.
 } ZIPENTRY;
 
 
 HZIP OpenZip(const TCHAR *fn, const char *password);
 HZIP OpenZip(void *z,unsigned int len, const char *password);
 HZIP OpenZipHandle(HANDLE h, const char *password);
+HZIP OpenZipMapped(const TCHAR *fn, const char *password);
 // OpenZip - opens a zip file and returns a handle with which you can
 // subsequently examine its contents. You can open a zip file from:
 // from a pipe:             OpenZipHandle(hpipe_read,0);
@@ -59,6 +61,10 @@ HZIP OpenZipHandle(HANDLE h, const char *password);
 // Note: for windows-ce, you cannot close the handle until after CloseZip.
 // but for real windows, the zip makes its own copy of your handle, so you
 // can close yours anytime.
+// OpenZipMapped opens a file (by name) like OpenZip, but maps it in memory
+// where the system allows it (otherwise it's read as a file). Deflated items
+// are then inflated straight from the mapping, and stored items can be seen
+// in place with GetZipItemView.
 
 ZRESULT GetZipItem(HZIP hz, int index, ZIPENTRY *ze);
 // GetZipItem - call this to get information about an item in the zip.
@@ -99,10 +105,34 @@ ZRESULT UnzipItemHandle(HZIP hz, int index, HANDLE h);
 // If you unzip a directory with ZIP_FILENAME, then the directory gets created.
 // If you unzip it to a handle or a memory block, then nothing gets created
 // and it emits 0 bytes.
+ZRESULT GetZipItemView(HZIP hz, int index, const void **data, long long *len);
+// GetZipItemView - gives the content of a stored (not compressed, not encrypted)
+// item of a zip opened with OpenZipMapped or from a memory block, in place,
+// without any copy: *data points to its len bytes, valid until CloseZip.
+// Returns ZR_NOTMMAP for any other item, which must then be unzipped.
+// Note: the content is not checked against its crc.
+typedef struct
+{ int method;               // 0 if stored, 8 if deflated
+  unsigned long crc;        // crc-32 of the uncompressed content
+  const void *data;         // the data as it is in the zip, i.e. still compressed
+  long long comp_size;      // size of data
+  long long unc_size;
+} ZIPRAWITEM;
+ZRESULT GetZipItemRaw(HZIP hz, int index, ZIPRAWITEM *raw);
+// GetZipItemRaw - like GetZipItemView, but for a stored or a deflated item (not
+// encrypted): its data is given in place without being inflated, with what is
+// needed to copy it as it is into another zip (see ZipAddRaw).
+// Returns ZR_NOTMMAP for any other item.
 ZRESULT SetUnzipBaseDir(HZIP hz, const TCHAR *dir);
 // if unzipping to a filename, and it's a relative filename, then it will be relative to here.
 // (defaults to current-directory).
 
+ZRESULT UnzipZlibBuffer(const void *src, unsigned int srclen, void *dst, unsigned int *dstlen);
+// UnzipZlibBuffer - inflates a zlib stream (RFC 1950: 2-byte header, deflate data, adler32)
+// held in memory, as produced by Qt's qCompress once its 4-byte length prefix is removed.
+// On input *dstlen is the size of dst, on output it is the number of bytes produced.
+// Returns ZR_MEMSIZE if dst is too small, ZR_FLATE if the stream is corrupt.
+
 
 ZRESULT CloseZip(HZIP hz);
 // CloseZip - the zip handle must be closed with this function.
@@ -11,8 +11,14 @@
 #include <memory.h>
 #include <string.h>
 #include <ctype.h>
+#include <math.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "zip.h"
+#include "crc32.h"
 //
 typedef unsigned short WORD;
 #define _tcslen strlen
@@ -36,6 +42,7 @@ typedef unsigned short WORD;
 #include <ctype.h>
 #include <stdio.h>
 #include "zip.h"
+#include "crc32.h"
 #endif
 
 
@@ -103,8 +110,9 @@ typedef unsigned short WORD;
 typedef unsigned char uch;      // unsigned 8-bit value
 typedef unsigned short ush;     // unsigned 16-bit value
 typedef unsigned long ulg;      // unsigned 32-bit value
+typedef unsigned long long uzoff_t; // unsigned 64-bit value, for sizes and offsets (Zip64)
 typedef size_t extent;          // file size
-typedef unsigned Pos;   // must be at least 32 bits
+typedef ush Pos;        // window index, the window is 64K
 typedef unsigned IPos; // A Pos is an index in the character window. Pos is used only for parameter passing
 
 #ifndef EOF
@@ -159,6 +167,8 @@ typedef unsigned IPos; // A Pos is an index in the character window. Pos is used
 #define LOCHEAD 26
 #define CENHEAD 42
 #define ENDHEAD 18
+#define ZIP64ENDHEAD 52
+#define ZIP64LOCHEAD 16
 
 // Definitions for extra field handling:
 #define EB_HEADSIZE       4     /* length of a extra field block header */
@@ -172,11 +182,21 @@ typedef unsigned IPos; // A Pos is an index in the character window. Pos is used
 #define EB_UT_LEN(n)      (EB_UT_MINLEN + 4 * (n))
 #define EB_L_UT_SIZE    (EB_HEADSIZE + EB_UT_LEN(3))
 #define EB_C_UT_SIZE    (EB_HEADSIZE + EB_UT_LEN(1))
+#define EB_ID_ZIP64       0x0001 /* Zip64 extended information */
+#define EB_L_ZIP64_SIZE   (EB_HEADSIZE + 16) /* both sizes, in the local header */
+
+// Sizes and offsets from this value up do not fit in the 32-bit fields: they
+// go in a Zip64 extra field instead, and the 32-bit field is set to 0xFFFFFFFF.
+#define ZIP64_LIMIT       0xFFFFFFFFULL
+// The local header gets its Zip64 field before the data is compressed, so an item
+// must be well under 4GB to be sure that its compressed size won't exceed the limit.
+#define ZIP64_LOCAL_LIMIT (ZIP64_LIMIT - 0x1000000ULL)
 
 
 // Macros for writing machine integers to little-endian format
 #define PUTSH(a,f) {char _putsh_c=(char)((a)&0xff); wfunc(param,&_putsh_c,1); _putsh_c=(char)((a)>>8); wfunc(param,&_putsh_c,1);}
 #define PUTLG(a,f) {PUTSH((a) & 0xffff,(f)) PUTSH((a) >> 16,(f))}
+#define PUTLL(a,f) {PUTLG((a) & 0xffffffff,(f)) PUTLG((uzoff_t)(a) >> 32,(f))}
 
 
 // -- Structure of a ZIP file --
@@ -185,6 +205,8 @@ typedef unsigned IPos; // A Pos is an index in the character window. Pos is used
 #define CENSIG     0x02014b50L
 #define ENDSIG     0x06054b50L
 #define EXTLOCSIG  0x08074b50L
+#define ZIP64ENDSIG 0x06064b50L
+#define ZIP64LOCSIG 0x07064b50L
 
 
 #define MIN_MATCH  3
@@ -310,8 +332,8 @@ typedef unsigned IPos; // A Pos is an index in the character window. Pos is used
 
 // DEFLATE.CPP HEADER
 
-#define HASH_BITS  15
-// For portability to 16 bit machines, do not use values above 15.
+#define HASH_BITS  16
+// Window positions are 16 bits (Pos), so do not use values above 16.
 
 #define HASH_SIZE (unsigned)(1<<HASH_BITS)
 #define HASH_MASK (HASH_SIZE-1)
@@ -337,12 +359,6 @@ typedef unsigned IPos; // A Pos is an index in the character window. Pos is used
 // ===========================================================================
 // Local data used by the "longest match" routines.
 
-#define H_SHIFT  ((HASH_BITS+MIN_MATCH-1)/MIN_MATCH)
-// Number of bits by which ins_h and del_h must be shifted at each
-// input step. It must be such that after MIN_MATCH steps, the oldest
-// byte no longer takes part in the hash key, that is:
-//   H_SHIFT * MIN_MATCH >= HASH_BITS
-
 #define max_insert_length  max_lazy_match
 // Insert new strings in the hash table only if the match length
 // is not greater than this length. This saves time but degrades compression.
@@ -486,10 +502,10 @@ class TTreeState
   ulg opt_len;          // bit length of current block with optimal trees
   ulg static_len;       // bit length of current block with static trees
 
-  ulg cmpr_bytelen;     // total byte length of compressed file
+  uzoff_t cmpr_bytelen; // total byte length of compressed file
   ulg cmpr_len_bits;    // number of bits past 'cmpr_bytelen'
 
-  ulg input_len;        // total byte length of input file
+  uzoff_t input_len;    // total byte length of input file
   // input_len is for debugging only since we can get it by other means.
 
   ush *file_type;       // pointer to UNKNOWN, BINARY or ASCII
@@ -525,7 +541,7 @@ class TBitState
   // On 16 bit machines, the buffer is limited to 64K.
   unsigned out_size;
   // Size of current output buffer
-  ulg bits_sent;   // bit length of the compressed data  only needed for debugging???
+  uzoff_t bits_sent; // bit length of the compressed data  only needed for debugging???
 };
 
 
@@ -600,10 +616,13 @@ typedef struct iztimes {
 
 typedef struct zlist {
   ush vem, ver, flg, how;       // See central header in zipfile.c for what vem..off are
-  ulg tim, crc, siz, len;
+  ulg tim, crc;
+  uzoff_t siz, len;
   extent nam, ext, cext, com;   // offset of ext must be >= LOCHEAD
   ush dsk, att, lflg;           // offset of lflg must be >= LOCHEAD
-  ulg atx, off;
+  ulg atx;
+  uzoff_t off;
+  bool zip64;                   // the local header has a Zip64 extra field for the sizes
   char name[MAX_PATH];          // File name in zip file
   char *extra;                  // Extra field (set only if ext != 0)
   char *cextra;                 // Extra in central (set only if cext != 0)
@@ -624,6 +643,7 @@ typedef unsigned (*WRITEFUNC)(void *param, const char *buf, unsigned size);
 struct TState
 { void *param;
   int level; bool seekable;
+  bool sync; // if true, the data ends with a sync flush instead of the last block (see ideflate_chunked)
   READFUNC readfunc; FLUSHFUNC flush_outbuf;
   TTreeState ts; TBitState bs; TDeflateState ds;
   const char *err;
@@ -657,7 +677,7 @@ DWORD GetFilePosZ(HANDLE hfout)
   return ftell(hfout);
 }
 
-ZRESULT GetFileInfo(FILE *hf, ulg *attr, long *size, iztimes *times, ulg *timestamp)
+ZRESULT GetFileInfo(FILE *hf, ulg *attr, long long *size, iztimes *times, ulg *timestamp)
 { // The handle must be a handle to a file
   // The date and time is returned in a long with the date most significant to allow
   // unsigned integer comparison of absolute times. The attributes have two
@@ -717,7 +737,7 @@ DWORD GetFilePosZ(HANDLE hfout)
 }
 
 
-ZRESULT GetFileInfo(HANDLE hf, ulg *attr, long *size, iztimes *times, ulg *timestamp)
+ZRESULT GetFileInfo(HANDLE hf, ulg *attr, long long *size, iztimes *times, ulg *timestamp)
 { // The handle must be a handle to a file
   // The date and time is returned in a long with the date most significant to allow
   // unsigned integer comparison of absolute times. The attributes have two
@@ -752,7 +772,8 @@ ZRESULT GetFileInfo(HANDLE hf, ulg *attr, long *size, iztimes *times, ulg *times
   }
   //
   if (attr!=NULL) *attr = a;
-  if (size!=NULL) *size = hsize;
+  DWORD hsizehigh=0; GetFileSize(hf,&hsizehigh);
+  if (size!=NULL) *size = ((long long)hsizehigh<<32) | hsize;
   if (times!=NULL)
   { // lutime_t is 32bit number of seconds elapsed since 0:0:0GMT, Jan1, 1970.
     // but FILETIME is 64bit number of 100-nanosecs since Jan1, 1601
@@ -1331,10 +1352,11 @@ void send_all_trees(TState &state,int lcodes, int dcodes, int blcodes)
  * trees or store, and output the encoded block to the zip file. This function
  * returns the total compressed length (in bytes) for the file so far.
  */
-ulg flush_block(TState &state,char *buf, ulg stored_len, int eof)
+uzoff_t flush_block(TState &state,char *buf, ulg stored_len, int eof)
 {
     ulg opt_lenb, static_lenb; /* opt_len and static_len in bytes */
     int max_blindex;  /* index of last bit length code of non zero freq */
+    int last = eof && !state.sync; /* is it the last block of the deflate stream? */
 
     state.ts.flag_buf[state.ts.last_flags] = state.ts.flags; /* Save the flags for the last 8 items */
 
@@ -1390,21 +1412,21 @@ ulg flush_block(TState &state,char *buf, ulg stored_len, int eof)
          * successful. If LIT_BUFSIZE <= WSIZE, it is never too late to
          * transform a block into a stored block.
          */
-        send_bits(state,(STORED_BLOCK<<1)+eof, 3);  /* send block type */
+        send_bits(state,(STORED_BLOCK<<1)+last, 3);  /* send block type */
         state.ts.cmpr_bytelen += ((state.ts.cmpr_len_bits + 3 + 7) >> 3) + stored_len + 4;
         state.ts.cmpr_len_bits = 0L;
 
         copy_block(state,buf, (unsigned)stored_len, 1); /* with header */
     }
     else if (static_lenb == opt_lenb) {
-        send_bits(state,(STATIC_TREES<<1)+eof, 3);
+        send_bits(state,(STATIC_TREES<<1)+last, 3);
         compress_block(state,(ct_data *)state.ts.static_ltree, (ct_data *)state.ts.static_dtree);
         state.ts.cmpr_len_bits += 3 + state.ts.static_len;
         state.ts.cmpr_bytelen += state.ts.cmpr_len_bits >> 3;
         state.ts.cmpr_len_bits &= 7L;
     }
     else {
-        send_bits(state,(DYN_TREES<<1)+eof, 3);
+        send_bits(state,(DYN_TREES<<1)+last, 3);
         send_all_trees(state,state.ts.l_desc.max_code+1, state.ts.d_desc.max_code+1, max_blindex+1);
         compress_block(state,(ct_data *)state.ts.dyn_ltree, (ct_data *)state.ts.dyn_dtree);
         state.ts.cmpr_len_bits += 3 + state.ts.opt_len;
@@ -1414,6 +1436,15 @@ ulg flush_block(TState &state,char *buf, ulg stored_len, int eof)
     Assert(state,((state.ts.cmpr_bytelen << 3) + state.ts.cmpr_len_bits) == state.bs.bits_sent, "bad compressed size");
     init_block(state);
 
+    if (eof && state.sync) {
+        /* An empty stored block aligns the output on a byte boundary,
+         * so that another deflate stream can be appended to this one.
+         */
+        send_bits(state,(STORED_BLOCK<<1), 3);
+        state.ts.cmpr_bytelen += ((state.ts.cmpr_len_bits + 3 + 7) >> 3) + 4;
+        state.ts.cmpr_len_bits = 0L;
+        copy_block(state,state.bs.out_buf, 0, 1);
+    }
     if (eof) {
         // Assert(state,input_len == isize, "bad input size");
         bi_windup(state);
@@ -1648,29 +1679,28 @@ void copy_block(TState &state, char *block, unsigned len, int header)
  */
 
 void fill_window  (TState &state);
-ulg deflate_fast  (TState &state);
+uzoff_t deflate_fast (TState &state);
 
 int  longest_match (TState &state,IPos cur_match);
 
 
 /* ===========================================================================
- * Update a hash value with the given input byte
- * IN  assertion: all calls to to UPDATE_HASH are made with consecutive
- *    input characters, so that a running hash key can be computed from the
- *    previous key instead of complete recalculation each time.
+ * Hash the MIN_MATCH bytes at p. This is a multiplicative hash of the three
+ * bytes rather than the rolling shift-and-xor of the original code. Its
+ * buckets are spread more evenly, so the chains hold fewer strings that
+ * only share a hash, and it does not depend on the previous position.
  */
-#define UPDATE_HASH(h,c) (h = (((h)<<H_SHIFT) ^ (c)) & HASH_MASK)
+#define HASH3(p) ((((unsigned)(p)[0] | (unsigned)(p)[1]<<8 | (unsigned)(p)[2]<<16) * 0x9E3779B1u) >> (32-HASH_BITS))
 
 /* ===========================================================================
  * Insert string s in the dictionary and set match_head to the previous head
  * of the hash chain (the most recent string with same hash key). Return
  * the previous length of the hash chain.
- * IN  assertion: all calls to to INSERT_STRING are made with consecutive
- *    input characters and the first MIN_MATCH bytes of s are valid
+ * IN  assertion: the first MIN_MATCH bytes of s are valid
  *    (except for the last MIN_MATCH-1 bytes of the input file).
  */
 #define INSERT_STRING(s, match_head) \
-   (UPDATE_HASH(state.ds.ins_h, state.ds.window[(s) + (MIN_MATCH-1)]), \
+   (state.ds.ins_h = HASH3(state.ds.window+(s)), \
     state.ds.prev[(s) & WMASK] = match_head = state.ds.head[state.ds.ins_h], \
     state.ds.head[state.ds.ins_h] = (s))
 
@@ -1687,7 +1717,7 @@ void lm_init (TState &state, int pack_level, ush *flags)
 {
     register unsigned j;
 
-    Assert(state,pack_level>=1 && pack_level<=8,"bad pack level");
+    Assert(state,pack_level>=1 && pack_level<=9,"bad pack level");
 
     /* Do not slide the window if the whole input is already in memory
      * (window_size > 0)
@@ -1735,10 +1765,6 @@ void lm_init (TState &state, int pack_level, ush *flags)
     if (state.ds.lookahead < MIN_LOOKAHEAD) fill_window(state);
 
     state.ds.ins_h = 0;
-    for (j=0; j<MIN_MATCH-1; j++) UPDATE_HASH(state.ds.ins_h, state.ds.window[j]);
-    /* If lookahead < MIN_MATCH, ins_h is garbage, but this is
-     * not important since only literal bytes will be emitted.
-     */
 }
 
 
@@ -1753,6 +1779,74 @@ void lm_init (TState &state, int pack_level, ush *flags)
 // For 80x86 and 680x0 and ARM, an optimized version is in match.asm or
 // match.S. The code is functionally equivalent, so you can use the C version
 // if desired. Which I do so desire!
+//
+// The byte-by-byte comparison loop of the C version has been replaced by
+// match_len(), which compares a word or a vector at a time. The result is
+// the same, so the compressed output does not depend on the kernel picked.
+
+// match_len: number of equal leading bytes of a and b, at most 256.
+// Reads exactly 256 bytes from each, which longest_match allows for.
+typedef unsigned (*match_len_func)(const uch *a, const uch *b);
+
+static unsigned match_len_c(const uch *a, const uch *b)
+{ unsigned len=0;
+#if defined(__GNUC__) && defined(__BYTE_ORDER__)
+  for (; len<256; len+=8)
+  { unsigned long long x,y; memcpy(&x,a+len,8); memcpy(&y,b+len,8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (x!=y) return len + (__builtin_ctzll(x^y)>>3);
+#else
+    if (x!=y) return len + (__builtin_clzll(x^y)>>3);
+#endif
+  }
+#else
+  while (len<256 && a[len]==b[len]) len++;
+#endif
+  return len;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATCH_SIMD
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static unsigned match_len_sse2(const uch *a, const uch *b)
+{ for (unsigned len=0; len<256; len+=16)
+  { __m128i x = _mm_loadu_si128((const __m128i*)(a+len));
+    __m128i y = _mm_loadu_si128((const __m128i*)(b+len));
+    unsigned diff = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x,y)) ^ 0xFFFFu;
+    if (diff) return len + __builtin_ctz(diff);
+  }
+  return 256;
+}
+
+__attribute__((target("avx2")))
+static unsigned match_len_avx2(const uch *a, const uch *b)
+{ for (unsigned len=0; len<256; len+=32)
+  { __m256i x = _mm256_loadu_si256((const __m256i*)(a+len));
+    __m256i y = _mm256_loadu_si256((const __m256i*)(b+len));
+    unsigned diff = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x,y)) ^ 0xFFFFFFFFu;
+    if (diff) return len + __builtin_ctz(diff);
+  }
+  return 256;
+}
+#endif
+
+// get_ush: two bytes at any alignment, for comparing them in one go
+static inline ush get_ush(const uch *p)
+{ ush v; memcpy(&v,p,2); return v;
+}
+
+static match_len_func match_len_select()
+{
+#ifdef MATCH_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return match_len_avx2;
+  if (__builtin_cpu_supports("sse2")) return match_len_sse2;
+#endif
+  return match_len_c;
+}
+
 int longest_match(TState &state,IPos cur_match)
 {
     unsigned chain_length = state.ds.max_chain_length;   /* max hash chain length */
@@ -1771,9 +1865,9 @@ int longest_match(TState &state,IPos cur_match)
 
 
 
-    register uch *strend = state.ds.window + state.ds.strstart + MAX_MATCH;
-    register uch scan_end1  = scan[best_len-1];
-    register uch scan_end   = scan[best_len];
+    static const match_len_func match_len = match_len_select();
+    register ush scan_start = get_ush(scan);          /* first two bytes */
+    register ush scan_end   = get_ush(scan+best_len-1); /* two bytes ending the best match */
 
     /* Do not waste too much time if we already have a good match: */
     if (state.ds.prev_length >= state.ds.good_match) {
@@ -1789,41 +1883,23 @@ int longest_match(TState &state,IPos cur_match)
         /* Skip to next match if the match length cannot increase
          * or if the match length is less than 2:
          */
-        if (match[best_len]   != scan_end  ||
-            match[best_len-1] != scan_end1 ||
-            *match            != *scan     ||
-            *++match          != scan[1])      continue;
-
-        /* The check at best_len-1 can be removed because it will be made
-         * again later. (This heuristic is not always a win.)
-         * It is not necessary to compare scan[2] and match[2] since they
-         * are always equal when the other bytes match, given that
-         * the hash keys are equal and that HASH_BITS >= 8.
-         */
-        scan += 2, match++;
+        if (get_ush(match+best_len-1) != scan_end ||
+            get_ush(match)            != scan_start) continue;
 
-        /* We check for insufficient lookahead only every 8th comparison;
-         * the 256th check will be made at strstart+258.
+        /* The first two bytes are equal; compare the other 256 at most,
+         * up to strstart+258. scan[2] is compared too, as the hash
+         * does not guarantee it.
          */
-        do {
-        } while (*++scan == *++match && *++scan == *++match &&
-                 *++scan == *++match && *++scan == *++match &&
-                 *++scan == *++match && *++scan == *++match &&
-                 *++scan == *++match && *++scan == *++match &&
-                 scan < strend);
+        len = 2 + (int)match_len(scan+2, match+2);
 
-        Assert(state,scan <= state.ds.window+(unsigned)(state.ds.window_size-1), "wild scan");
-
-        len = MAX_MATCH - (int)(strend - scan);
-        scan = strend - MAX_MATCH;
+        Assert(state,scan+len <= state.ds.window+(unsigned)(state.ds.window_size-1), "wild scan");
 
 
         if (len > best_len) {
             state.ds.match_start = cur_match;
             best_len = len;
             if (len >= state.ds.nice_match) break;
-            scan_end1  = scan[best_len-1];
-            scan_end   = scan[best_len];
+            scan_end   = get_ush(scan+best_len-1);
         }
     } while ((cur_match = state.ds.prev[cur_match & WMASK]) > limit
              && --chain_length != 0);
@@ -1943,7 +2019,7 @@ void fill_window(TState &state)
  * new strings in the dictionary only for unmatched strings or for short
  * matches. It is used only for the fast compression options.
  */
-ulg deflate_fast(TState &state)
+uzoff_t deflate_fast(TState &state)
 {
     IPos hash_head = NIL;       /* head of the hash chain */
     int flush;                  /* set if current block must be flushed */
@@ -1997,9 +2073,6 @@ ulg deflate_fast(TState &state)
             } else {
                 state.ds.strstart += match_length;
                 match_length = 0;
-                state.ds.ins_h = state.ds.window[state.ds.strstart];
-                UPDATE_HASH(state.ds.ins_h, state.ds.window[state.ds.strstart+1]);
-                Assert(state,MIN_MATCH==3,"Call UPDATE_HASH() MIN_MATCH-3 more times");
             }
         } else {
             /* No match, output a literal byte */
@@ -2024,7 +2097,7 @@ ulg deflate_fast(TState &state)
  * evaluation for matches: a match is finally adopted only if there is
  * no better match at the next window position.
  */
-ulg deflate(TState &state)
+uzoff_t deflate(TState &state)
 {
     IPos hash_head = NIL;       /* head of hash chain */
     IPos prev_match;            /* previous match */
@@ -2147,12 +2220,18 @@ int putlocal(struct zlist *z, WRITEFUNC wfunc,void *param)
   PUTSH(z->how, f);
   PUTLG(z->tim, f);
   PUTLG(z->crc, f);
-  PUTLG(z->siz, f);
-  PUTLG(z->len, f);
+  PUTLG(z->zip64 ? ZIP64_LIMIT : z->siz, f);
+  PUTLG(z->zip64 ? ZIP64_LIMIT : z->len, f);
   PUTSH(z->nam, f);
-  PUTSH(z->ext, f);
+  PUTSH(z->ext + (z->zip64 ? EB_L_ZIP64_SIZE : 0), f);
   size_t res = (size_t)wfunc(param, z->iname, (unsigned int)z->nam);
   if (res!=z->nam) return ZE_TEMP;
+  if (z->zip64)
+  { PUTSH(EB_ID_ZIP64, f);
+    PUTSH(16, f);
+    PUTLL(z->len, f);
+    PUTLL(z->siz, f);
+  }
   if (z->ext)
   { res = (size_t)wfunc(param, z->extra, (unsigned int)z->ext);
     if (res!=z->ext) return ZE_TEMP;
@@ -2164,13 +2243,29 @@ int putextended(struct zlist *z, WRITEFUNC wfunc, void *param)
 { // Write an extended local header described by *z to file *f. Returns a ZE_ code
   PUTLG(EXTLOCSIG, f);
   PUTLG(z->crc, f);
-  PUTLG(z->siz, f);
-  PUTLG(z->len, f);
+  if (z->zip64)
+  { PUTLL(z->siz, f);
+    PUTLL(z->len, f);
+  }
+  else
+  { PUTLG(z->siz, f);
+    PUTLG(z->len, f);
+  }
   return ZE_OK;
 }
 
+extent central64size(struct zlist *z)
+{ // size of the Zip64 extra field in the central header of *z, or 0 if there's none
+  extent n = 0;
+  if (z->len >= ZIP64_LIMIT) n += 8;
+  if (z->siz >= ZIP64_LIMIT) n += 8;
+  if (z->off >= ZIP64_LIMIT) n += 8;
+  return n==0 ? 0 : EB_HEADSIZE + n;
+}
+
 int putcentral(struct zlist *z, WRITEFUNC wfunc, void *param)
 { // Write a central header entry of *z to file *f. Returns a ZE_ code.
+  extent x64 = central64size(z);
   PUTLG(CENSIG, f);
   PUTSH(z->vem, f);
   PUTSH(z->ver, f);
@@ -2178,17 +2273,25 @@ int putcentral(struct zlist *z, WRITEFUNC wfunc, void *param)
   PUTSH(z->how, f);
   PUTLG(z->tim, f);
   PUTLG(z->crc, f);
-  PUTLG(z->siz, f);
-  PUTLG(z->len, f);
+  PUTLG(z->siz >= ZIP64_LIMIT ? ZIP64_LIMIT : z->siz, f);
+  PUTLG(z->len >= ZIP64_LIMIT ? ZIP64_LIMIT : z->len, f);
   PUTSH(z->nam, f);
-  PUTSH(z->cext, f);
+  PUTSH(z->cext + x64, f);
   PUTSH(z->com, f);
   PUTSH(z->dsk, f);
   PUTSH(z->att, f);
   PUTLG(z->atx, f);
-  PUTLG(z->off, f);
-  if ((size_t)wfunc(param, z->iname, (unsigned int)z->nam) != z->nam ||
-      (z->cext && (size_t)wfunc(param, z->cextra, (unsigned int)z->cext) != z->cext) ||
+  PUTLG(z->off >= ZIP64_LIMIT ? ZIP64_LIMIT : z->off, f);
+  if ((size_t)wfunc(param, z->iname, (unsigned int)z->nam) != z->nam) return ZE_TEMP;
+  if (x64)
+  { // only the fields that overflow are there, in this order
+    PUTSH(EB_ID_ZIP64, f);
+    PUTSH(x64 - EB_HEADSIZE, f);
+    if (z->len >= ZIP64_LIMIT) PUTLL(z->len, f);
+    if (z->siz >= ZIP64_LIMIT) PUTLL(z->siz, f);
+    if (z->off >= ZIP64_LIMIT) PUTLL(z->off, f);
+  }
+  if ((z->cext && (size_t)wfunc(param, z->cextra, (unsigned int)z->cext) != z->cext) ||
       (z->com && (size_t)wfunc(param, z->comment, (unsigned int)z->com) != z->com))
     return ZE_TEMP;
   return ZE_OK;
@@ -2210,6 +2313,26 @@ int putend(int n, ulg s, ulg c, extent m, char *z, WRITEFUNC wfunc, void *param)
   return ZE_OK;
 }
 
+int putend64(uzoff_t n, uzoff_t s, uzoff_t c, uzoff_t e, WRITEFUNC wfunc, void *param)
+{ // write the Zip64 end of central directory record (at offset e), then its locator.
+  // They go just before the usual end record, which then holds 0xFFFF/0xFFFFFFFF values.
+  PUTLG(ZIP64ENDSIG, f);
+  PUTLL(ZIP64ENDHEAD - 8, f); // size of the rest of the record
+  PUTSH(45, f);               // version made by: zip 4.5
+  PUTSH(45, f);               // version needed to extract
+  PUTLG(0, f);
+  PUTLG(0, f);
+  PUTLL(n, f);
+  PUTLL(n, f);
+  PUTLL(s, f);
+  PUTLL(c, f);
+  PUTLG(ZIP64LOCSIG, f);
+  PUTLG(0, f);
+  PUTLL(e, f);
+  PUTLG(1, f);                // total number of disks
+  return ZE_OK;
+}
+
 
 
 
@@ -2271,17 +2394,40 @@ const ulg crc_table[256] = {
 };
 
 #define CRC32(c, b) (crc_table[((int)(c) ^ (b)) & 0xff] ^ ((c) >> 8))
-#define DO1(buf)  crc = CRC32(crc, *buf++)
-#define DO2(buf)  DO1(buf); DO1(buf)
-#define DO4(buf)  DO2(buf); DO2(buf)
-#define DO8(buf)  DO4(buf); DO4(buf)
 
 ulg crc32(ulg crc, const uch *buf, extent len)
-{ if (buf==NULL) return 0L;
-  crc = crc ^ 0xffffffffL;
-  while (len >= 8) {DO8(buf); len -= 8;}
-  if (len) do {DO1(buf);} while (--len);
-  return crc ^ 0xffffffffL;  // (instead of ~c for 64-bit machines)
+{ return zcrc32(crc,buf,len); // table, slicing-by-8 or hardware, see crc32.cpp
+}
+
+// crc32_combine: given crc1 of a first block and crc2 of a second block of len2 bytes,
+// returns the crc of both blocks put together. This is the GF(2) matrix method of zlib:
+// the crc1 register is moved forward by len2 zero bytes, then crc2 is added.
+ulg gf2_matrix_times(const ulg *mat, ulg vec)
+{ ulg sum=0;
+  while (vec) {if (vec&1) sum ^= *mat; vec>>=1; mat++;}
+  return sum;
+}
+
+void gf2_matrix_square(ulg *square, const ulg *mat)
+{ for (int n=0; n<32; n++) square[n] = gf2_matrix_times(mat,mat[n]);
+}
+
+ulg crc32_combine(ulg crc1, ulg crc2, ulg len2)
+{ if (len2==0) return crc1;
+  ulg even[32], odd[32];  // even- and odd-power-of-two zeros operators
+  odd[0] = 0xedb88320L;   // the operator for one zero bit
+  ulg row=1; for (int n=1; n<32; n++) {odd[n]=row; row<<=1;}
+  gf2_matrix_square(even,odd); // two zero bits
+  gf2_matrix_square(odd,even); // four zero bits
+  do
+  { gf2_matrix_square(even,odd); // first square puts the operator for one zero byte in even
+    if (len2&1) crc1 = gf2_matrix_times(even,crc1);
+    len2 >>= 1; if (len2==0) break;
+    gf2_matrix_square(odd,even);
+    if (len2&1) crc1 = gf2_matrix_times(odd,crc1);
+    len2 >>= 1;
+  } while (len2!=0);
+  return (crc1^crc2) & 0xffffffffL;
 }
 
 
@@ -2332,6 +2478,41 @@ bool HasZipSuffix(const TCHAR *fn)
   if (lustricmp(ext,_T(".tgz"))==0) return true;
   return false;
 }
+bool HasCompressedAudioSuffix(const TCHAR *fn)
+{ const TCHAR *ext = fn+_tcslen(fn);
+  while (ext>fn && *ext!='.') ext--;
+  if (ext==fn && *ext!='.') return false;
+  if (lustricmp(ext,_T(".ogg"))==0) return true;
+  if (lustricmp(ext,_T(".oga"))==0) return true;
+  if (lustricmp(ext,_T(".opus"))==0) return true;
+  if (lustricmp(ext,_T(".flac"))==0) return true;
+  if (lustricmp(ext,_T(".mp3"))==0) return true;
+  if (lustricmp(ext,_T(".m4a"))==0) return true;
+  if (lustricmp(ext,_T(".aac"))==0) return true;
+  if (lustricmp(ext,_T(".wma"))==0) return true;
+  if (lustricmp(ext,_T(".sf3"))==0) return true;
+  return false;
+}
+
+// Order-0 entropy of a block, in bits per byte (0..8).
+// Deflate cannot do much better than this on data without long repetitions,
+// so there is no point in deflating a block that is close to 8.
+double BlockEntropy(const unsigned char *buf, unsigned int len)
+{ if (len==0) return 0.0;
+  unsigned int counts[256]; memset(counts,0,sizeof(counts));
+  for (unsigned int i=0; i<len; i++) counts[buf[i]]++;
+  double entropy=0.0;
+  for (int c=0; c<256; c++)
+  { if (counts[c]==0) continue;
+    double p = (double)counts[c]/(double)len;
+    entropy -= p*log2(p);
+  }
+  return entropy;
+}
+
+#define ENTROPY_PROBE_SIZE 16384
+#define ENTROPY_STORE_THRESHOLD 7.5  // bits per byte
+#define PROBE_STORE_RATIO 0.97       // deflated size of the probe over its size
 
 
 
@@ -2342,8 +2523,8 @@ bool HasZipSuffix(const TCHAR *fn)
 
 class TZip
 { public:
-  TZip(const char *pwd) : hfout(0),mustclosehfout(false),hmapout(0),zfis(0),obuf(0),hfin(0),writ(0),oerr(false),hasputcen(false),ooffset(0),encwriting(false),encbuf(0),password(0), state(0) {if (pwd!=0 && *pwd!=0) {password=new char[strlen(pwd)+1]; strcpy(password,pwd);}}
-  ~TZip() {if (state!=0) delete state; state=0; if (encbuf!=0) delete[] encbuf; encbuf=0; if (password!=0) delete[] password; password=0;}
+  TZip(const char *pwd) : hfout(0),mustclosehfout(false),hmapout(0),zfis(0),obuf(0),ogrow(false),hfin(0),writ(0),oerr(false),hasputcen(false),ooffset(0),encwriting(false),encbuf(0),password(0), state(0), storepolicy(ZIP_STORE_ARCHIVES), level(ZIP_DEFAULT_LEVEL), jobs(1) {if (pwd!=0 && *pwd!=0) {password=new char[strlen(pwd)+1]; strcpy(password,pwd);}}
+  ~TZip() {if (state!=0) delete state; state=0; if (encbuf!=0) delete[] encbuf; encbuf=0; if (password!=0) delete[] password; password=0; if (ogrow && obuf!=0) free(obuf); obuf=0;}
 
   // These variables say about the file we're writing into
   // We can write to pipe, file-by-handle, file-by-name, memory-to-memmapfile
@@ -2353,9 +2534,10 @@ class TZip
   HANDLE hmapout;           // otherwise, we'll write here (for memmap)
   unsigned ooffset;         // for hfout, this is where the pointer was initially
   ZRESULT oerr;             // did a write operation give rise to an error?
-  unsigned writ;            // how far have we written. This is maintained by Add, not write(), to avoid confusion over seeks
+  uzoff_t writ;             // how far have we written. This is maintained by Add, not write(), to avoid confusion over seeks
   bool ocanseek;            // can we seek?
   char *obuf;               // this is where we've locked mmap to view.
+  bool ogrow;               // if true, obuf is a heap block of ours that grows as needed (ZIP_STD memory zips)
   unsigned int opos;        // current pos in the mmap
   unsigned int mapsize;     // the size of the map we created
   bool hasputcen;           // have we yet placed the central directory?
@@ -2366,12 +2548,15 @@ class TZip
   //
   TZipFileInfo *zfis;       // each file gets added onto this list, for writing the table at the end
   TState *state;            // we use just one state object per zip, because it's big (500k)
+  DWORD storepolicy;        // which items are stored instead of deflated (ZIP_STORE_*)
+  int level;                // deflate level, 1 (fastest) to 9 (smallest). 0 means that every item is stored
+  unsigned int jobs;        // number of threads that can deflate one big item (see ideflate_chunked)
 
   ZRESULT Create(void *z,unsigned int len,DWORD flags);
   static unsigned sflush(void *param,const char *buf, unsigned *size);
   static unsigned swrite(void *param,const char *buf, unsigned size);
   unsigned int write(const char *buf,unsigned int size);
-  bool oseek(unsigned int pos);
+  bool oseek(uzoff_t pos);
   ZRESULT GetMemory(void **pbuf, unsigned long *plen);
   ZRESULT Close();
 
@@ -2379,12 +2564,12 @@ class TZip
   // I haven't done it object-orientedly here, just put them all
   // together, since OO didn't seem to make the design any clearer.
   ulg attr; iztimes times; ulg timestamp;  // all open_* methods set these
-  bool iseekable; long isize,ired;         // size is not set until close() on pips
+  bool iseekable; long long isize,ired;    // size is not set until close() on pips
   ulg crc;                                 // crc is not set until close(). iwrit is cumulative
   HANDLE hfin; bool selfclosehf;           // for input files and pipes
   const char *bufin; unsigned int lenin,posin; // for memory
   // and a variable for what we've done with the input: (i.e. compressed it!)
-  ulg csize;                               // compressed size, set by the compression routines
+  uzoff_t csize;                           // compressed size, set by the compression routines
   // and this is used by some of the compression routines
   char buf[16384];
 
@@ -2395,12 +2580,21 @@ class TZip
   ZRESULT open_dir();
   static unsigned sread(TState &s,char *buf,unsigned size);
   unsigned read(char *buf, unsigned size);
+  unsigned readraw(char *buf, unsigned size);
   ZRESULT iclose();
 
   ZRESULT ideflate(TZipFileInfo *zfi);
+  ZRESULT ideflate_chunked(TZipFileInfo *zfi);
   ZRESULT istore();
+  bool ihighentropy();
 
+  void initinfo(TZipFileInfo &zfi, const TCHAR *dstzn, bool isdir, bool needs_trailing_slash, int method, int passex, char *xloc, char *xcen);
+  void keepinfo(TZipFileInfo &zfi);
   ZRESULT Add(const TCHAR *odstzn, void *src,unsigned int len, DWORD flags);
+  ZRESULT AddRaw(const TCHAR *odstzn, const TCHAR *fn, const void *data, uzoff_t rawsize, ulg rawcrc, int method);
+  ZRESULT AddFiles(int count, const TCHAR * const *dstzn, const TCHAR * const *fn, unsigned int njobs);
+  ZRESULT AddFilesParallel(int count, const TCHAR * const *dstzn, const TCHAR * const *fn);
+  ZRESULT AddPrepared(TZip *prepared);
   ZRESULT AddCentral();
 
 };
@@ -2443,7 +2637,11 @@ ZRESULT TZip::Create(void *z,unsigned int len,DWORD flags)
     if (size==0) return ZR_MEMSIZE;
 #ifdef ZIP_STD
     if (z!=0) obuf=(char*)z;
-    else return ZR_ARGS;
+    else
+    { obuf = (char*)malloc(size);
+      if (obuf==0) return ZR_NOALLOC;
+      ogrow=true;
+    }
 #else
     if (z!=0) obuf=(char*)z;
     else
@@ -2483,7 +2681,13 @@ unsigned int TZip::write(const char *buf,unsigned int size)
     srcbuf=encbuf;
   }
   if (obuf!=0)
-  { if (opos+size>=mapsize) {oerr=ZR_MEMSIZE; return 0;}
+  { if (opos+size>=mapsize && ogrow)
+    { unsigned int newsize=mapsize; while (opos+size>=newsize && newsize<0x80000000) newsize*=2;
+      char *newbuf = (opos+size<newsize) ? (char*)realloc(obuf,newsize) : 0;
+      if (newbuf==0) {oerr=ZR_NOALLOC; return 0;}
+      obuf=newbuf; mapsize=newsize;
+    }
+    if (opos+size>=mapsize) {oerr=ZR_MEMSIZE; return 0;}
     memcpy(obuf+opos, srcbuf, size);
     opos+=size;
     return size;
@@ -2500,7 +2704,7 @@ unsigned int TZip::write(const char *buf,unsigned int size)
   oerr=ZR_NOTINITED; return 0;
 }
 
-bool TZip::oseek(unsigned int pos)
+bool TZip::oseek(uzoff_t pos)
 { if (!ocanseek) {oerr=ZR_SEEK; return false;}
   if (obuf!=0)
   { if (pos>=mapsize) {oerr=ZR_MEMSIZE; return false;}
@@ -2510,9 +2714,9 @@ bool TZip::oseek(unsigned int pos)
   else if (hfout!=0)
   {
 #ifdef ZIP_STD
-    fseek(hfout,pos+ooffset,SEEK_SET);
+    fseeko(hfout,(off_t)(pos+ooffset),SEEK_SET);
 #else
-    SetFilePointer(hfout,pos+ooffset,NULL,FILE_BEGIN);
+    LONG high=(LONG)((pos+ooffset)>>32); SetFilePointer(hfout,(LONG)(pos+ooffset),&high,FILE_BEGIN);
 #endif
     return true;
   }
@@ -2630,14 +2834,21 @@ unsigned TZip::sread(TState &s,char *buf,unsigned size)
 }
 
 unsigned TZip::read(char *buf, unsigned size)
-{ if (bufin!=0)
+{ unsigned red = readraw(buf,size);
+  if (red==0) return 0;
+  ired += red;
+  crc = crc32(crc, (uch*)buf, red);
+  return red;
+}
+
+unsigned TZip::readraw(char *buf, unsigned size)
+{ // reads without updating ired and crc
+  if (bufin!=0)
   { if (posin>=lenin) return 0; // end of input
     ulg red = lenin-posin;
     if (red>size) red=size;
     memcpy(buf, bufin+posin, red);
     posin += red;
-    ired += red;
-    crc = crc32(crc, (uch*)buf, red);
     return red;
   }
   else if (hfin!=0)
@@ -2649,8 +2860,6 @@ unsigned TZip::read(char *buf, unsigned size)
     BOOL ok = ReadFile(hfin,buf,size,&red,NULL);
     if (!ok) return 0;
 #endif
-    ired += red;
-    crc = crc32(crc, (uch*)buf, red);
     return red;
   }
   else {oerr=ZR_NOTINITED; return 0;}
@@ -2671,13 +2880,124 @@ ZRESULT TZip::iclose()
 
 
 
+// A big item can be deflated by several threads: its data is cut in pieces of
+// ZIP_CHUNK_SIZE bytes, and each piece is deflated on its own, like pigz does.
+// All pieces but the last one end with a sync flush, so the pieces put together
+// are one deflate stream that any inflater reads. Matches do not cross pieces,
+// which makes the item a little bigger than with ideflate.
+#define ZIP_CHUNK_SIZE (4*1024*1024)
+#define ZIP_CHUNK_THRESHOLD (64*1024*1024) // smaller items are not worth it
+
+typedef struct TChunk
+{ char *in; unsigned int lenin,posin;  // the piece of data
+  std::vector<char> out;               // the piece of deflate stream
+  ulg crc; ush att,flg; bool last;
+  const char *err; bool done;
+} TChunk;
+
+unsigned ChunkRead(TState &state, char *buf, unsigned size)
+{ TChunk *chunk = (TChunk*)state.param;
+  unsigned int red = chunk->lenin-chunk->posin; if (red>size) red=size;
+  memcpy(buf,chunk->in+chunk->posin,red); chunk->posin+=red;
+  return red;
+}
+
+unsigned ChunkFlush(void *param, const char *buf, unsigned *size)
+{ TChunk *chunk = (TChunk*)param;
+  chunk->out.insert(chunk->out.end(),buf,buf+*size);
+  unsigned int writ=*size; *size=0; return writ;
+}
+
+ZRESULT TZip::ideflate_chunked(TZipFileInfo *zfi)
+{ // Each worker reads the next piece (reads are done in order, one at a time)
+  // and deflates it. This thread writes the pieces in order. At most 2*jobs pieces
+  // are in memory at the same time.
+  const long count = (isize+ZIP_CHUNK_SIZE-1)/ZIP_CHUNK_SIZE;
+  std::vector<TChunk> chunks(count);
+  std::mutex mutex; std::condition_variable cond;
+  long next=0, written=0; bool stop=false;
+  const long window = (long)(2*jobs);
+
+  auto worker = [&]()
+  { TState *st = 0;
+    for (;;)
+    { TChunk *chunk;
+      { std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&]{return stop || next>=count || next<written+window;});
+        if (stop || next>=count) break;
+        long i=next++; chunk=&chunks[i];
+        chunk->lenin = (unsigned int)(i<count-1 ? ZIP_CHUNK_SIZE : isize-(long)ZIP_CHUNK_SIZE*(count-1));
+        chunk->posin=0; chunk->last=(i==count-1); chunk->err=0;
+        chunk->in = new char[chunk->lenin];
+        unsigned int red=0;
+        while (red<chunk->lenin) {unsigned int n=readraw(chunk->in+red,chunk->lenin-red); if (n==0) break; red+=n;}
+        if (red!=chunk->lenin) chunk->err="missing data";
+      }
+      if (chunk->err==0)
+      { if (st==0) st=new TState();
+        st->readfunc=ChunkRead; st->flush_outbuf=ChunkFlush;
+        st->param=chunk; st->level=level; st->seekable=false; st->sync=!chunk->last; st->err=NULL;
+        st->ts.static_dtree[0].dl.len = 0;
+        st->ds.window_size=0;
+        char outbuf[16384];
+        chunk->att=0; chunk->flg=0;
+        bi_init(*st,outbuf,sizeof(outbuf),1);
+        ct_init(*st,&chunk->att);
+        lm_init(*st,st->level,&chunk->flg);
+        deflate(*st);
+        chunk->err=st->err;
+        chunk->crc=crc32(CRCVAL_INITIAL,(uch*)chunk->in,chunk->lenin);
+      }
+      delete[] chunk->in; chunk->in=0;
+      { std::lock_guard<std::mutex> lock(mutex);
+        chunk->done=true;
+      }
+      cond.notify_all();
+    }
+    if (st!=0) delete st;
+  };
+
+  for (long i=0; i<count; i++) {chunks[i].in=0; chunks[i].done=false;}
+  std::vector<std::thread> threads;
+  for (unsigned int t=0; t<jobs && (long)t<count; t++) threads.push_back(std::thread(worker));
+
+  ZRESULT res=ZR_OK;
+  for (long i=0; i<count && res==ZR_OK; i++)
+  { { std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [&]{return chunks[i].done;});
+    }
+    TChunk &chunk = chunks[i];
+    if (chunk.err!=0) res=ZR_FLATE;
+    else
+    { unsigned int size = (unsigned int)chunk.out.size();
+      if (size>0 && write(&chunk.out[0],size)!=size) res=ZR_WRITE;
+      csize += size;
+      crc = crc32_combine(crc,chunk.crc,chunk.lenin);
+      ired += chunk.lenin;
+      if (i==0) zfi->att=chunk.att;
+      zfi->flg |= chunk.flg;
+    }
+    std::vector<char>().swap(chunk.out);
+    { std::lock_guard<std::mutex> lock(mutex);
+      written=i+1;
+      if (res!=ZR_OK) stop=true;
+    }
+    cond.notify_all();
+  }
+  { std::lock_guard<std::mutex> lock(mutex); stop=true; }
+  cond.notify_all();
+  for (size_t t=0; t<threads.size(); t++) threads[t].join();
+  return res;
+}
+
 ZRESULT TZip::ideflate(TZipFileInfo *zfi)
-{ if (state==0) state=new TState();
+{ if (jobs>1 && isize>=ZIP_CHUNK_THRESHOLD) return ideflate_chunked(zfi);
+  if (state==0) state=new TState();
   // It's a very big object! 500k! We allocate it on the heap, because PocketPC's
   // stack breaks if we try to put it all on the stack. It will be deleted lazily
   state->err=0;
   state->readfunc=sread; state->flush_outbuf=sflush;
-  state->param=this; state->level=8; state->seekable=iseekable; state->err=NULL;
+  state->param=this; state->level=level; state->seekable=iseekable; state->sync=false; state->err=NULL;
   // the following line will make ct_init realise it has to perform the init
   state->ts.static_dtree[0].dl.len = 0;
   // Thanks to Alvin77 for this crucial fix:
@@ -2687,12 +3007,51 @@ ZRESULT TZip::ideflate(TZipFileInfo *zfi)
   bi_init(*state,buf, sizeof(buf), 1); // it used to be just 1024-size, not 16384 as here
   ct_init(*state,&zfi->att);
   lm_init(*state,state->level, &zfi->flg);
-  ulg sz = deflate(*state);
+  uzoff_t sz = deflate(*state);
   csize=sz;
   ZRESULT r=ZR_OK; if (state->err!=NULL) r=ZR_FLATE;
   return r;
 }
 
+// ProbeDeflateSize: size of the block deflated at level 1, in memory.
+unsigned int ProbeDeflateSize(TState &st, const char *data, unsigned int len)
+{ TChunk chunk; chunk.in=(char*)data; chunk.lenin=len; chunk.posin=0; chunk.last=true; chunk.err=0;
+  st.readfunc=ChunkRead; st.flush_outbuf=ChunkFlush;
+  st.param=&chunk; st.level=1; st.seekable=false; st.sync=false; st.err=NULL;
+  st.ts.static_dtree[0].dl.len = 0;
+  st.ds.window_size=0;
+  char outbuf[16384]; ush att=0, flg=0;
+  bi_init(st,outbuf,sizeof(outbuf),1);
+  ct_init(st,&att);
+  lm_init(st,st.level,&flg);
+  deflate(st);
+  return (unsigned int)chunk.out.size();
+}
+
+bool TZip::ihighentropy()
+{ // looks at the first block of the opened input, without consuming it
+  const char *probe=buf; unsigned int len=0;
+  if (bufin!=0) {probe=bufin; len = lenin<ENTROPY_PROBE_SIZE ? lenin : ENTROPY_PROBE_SIZE;}
+  else
+  { if (hfin==0 || !iseekable) return false;
+#ifdef ZIP_STD
+    len = (unsigned int)fread(buf,1,ENTROPY_PROBE_SIZE,hfin);
+    fseek(hfin,0,SEEK_SET);
+#else
+    DWORD red=0; if (!ReadFile(hfin,buf,ENTROPY_PROBE_SIZE,&red,NULL)) red=0;
+    SetFilePointer(hfin,0,NULL,FILE_BEGIN);
+    len=red;
+#endif
+  }
+  if (len==0 || BlockEntropy((const unsigned char*)probe,len) < ENTROPY_STORE_THRESHOLD) return false;
+  // The entropy only measures the byte frequencies: long repetitions of a
+  // random-looking pattern have a high entropy, but deflate very well. So the
+  // block is also deflated (at the fastest level), and the item is stored only
+  // if that does not pay either.
+  if (state==0) state=new TState();
+  return ProbeDeflateSize(*state,probe,len) >= len*PROBE_STORE_RATIO;
+}
+
 ZRESULT TZip::istore()
 { ulg size=0;
   for (;;)
@@ -2709,35 +3068,10 @@ ZRESULT TZip::istore()
 
 
 bool has_seeded=false;
-ZRESULT TZip::Add(const TCHAR *odstzn, void *src,unsigned int len, DWORD flags)
-{ if (oerr) return ZR_FAILED;
-  if (hasputcen) return ZR_ENDED;
-
-  // if we use password encryption, then every isize and csize is 12 bytes bigger
-  int passex=0; if (password!=0 && flags!=ZIP_FOLDER) passex=12;
-
-  // zip has its own notion of what its names should look like: i.e. dir/file.stuff
-  TCHAR dstzn[MAX_PATH]; _tcsncpy(dstzn,odstzn,MAX_PATH); dstzn[MAX_PATH-1]=0;
-  if (*dstzn==0) return ZR_ARGS;
-  TCHAR *d=dstzn; while (*d!=0) {if (*d=='\\') *d='/'; d++;}
-  bool isdir = (flags==ZIP_FOLDER);
-  bool needs_trailing_slash = (isdir && dstzn[_tcslen(dstzn)-1]!='/');
-  int method=DEFLATE; if (isdir || HasZipSuffix(dstzn)) method=STORE;
-
-  // now open whatever was our input source:
-  ZRESULT openres;
-  if (flags==ZIP_FILENAME) openres=open_file((const TCHAR*)src);
-  else if (flags==ZIP_HANDLE) openres=open_handle((HANDLE)src,len);
-  else if (flags==ZIP_MEMORY) openres=open_mem(src,len);
-  else if (flags==ZIP_FOLDER) openres=open_dir();
-  else return ZR_ARGS;
-  if (openres!=ZR_OK) return openres;
-
-  // A zip "entry" consists of a local header (which includes the file name),
-  // then the compressed data, and possibly an extended local header.
-
-  // Initialize the local header
-  TZipFileInfo zfi; zfi.nxt=NULL;
+void TZip::initinfo(TZipFileInfo &zfi, const TCHAR *dstzn, bool isdir, bool needs_trailing_slash, int method, int passex, char *xloc, char *xcen)
+{ // the local header of the item being added, from what open_* found about its input.
+  // xloc and xcen hold the extra fields, EB_L_UT_SIZE and EB_C_UT_SIZE bytes.
+  zfi.nxt=NULL;
   strcpy(zfi.name,"");
 #ifdef UNICODE
   WideCharToMultiByte(CP_UTF8,0,dstzn,-1,zfi.iname,MAX_PATH,0,0);
@@ -2762,16 +3096,19 @@ ZRESULT TZip::Add(const TCHAR *odstzn, void *src,unsigned int len, DWORD flags)
   if (password!=0 && !isdir) zfi.flg=9;  // and 1 means 'password-encrypted'
   zfi.lflg = zfi.flg;     // to be updated later
   zfi.how = (ush)method;  // to be updated later
-  zfi.siz = (ulg)(method==STORE && isize>=0 ? isize+passex : 0); // to be updated later
-  zfi.len = (ulg)(isize);  // to be updated later
+  zfi.siz = (uzoff_t)(method==STORE && isize>=0 ? isize+passex : 0); // to be updated later
+  zfi.len = (uzoff_t)(isize>=0 ? isize : 0);  // to be updated later
   zfi.dsk = 0;
   zfi.atx = attr;
   zfi.off = writ+ooffset;         // offset within file of the start of this local record
+  // big items (or items of unknown size) have their sizes in a Zip64 extra field
+  zfi.zip64 = (!isdir && (isize<0 || (uzoff_t)isize+passex>=ZIP64_LOCAL_LIMIT));
+  if (zfi.zip64 || zfi.off>=ZIP64_LIMIT) zfi.ver = (ush)45; // Needs PKUNZIP 4.5 to unzip it
   // stuff the 'times' structure into zfi.extra
 
   // nb. apparently there's a problem with PocketPC CE(zip)->CE(unzip) fails. And removing the following block fixes it up.
-  char xloc[EB_L_UT_SIZE]; zfi.extra=xloc;  zfi.ext=EB_L_UT_SIZE;
-  char xcen[EB_C_UT_SIZE]; zfi.cextra=xcen; zfi.cext=EB_C_UT_SIZE;
+  zfi.extra=xloc;  zfi.ext=EB_L_UT_SIZE;
+  zfi.cextra=xcen; zfi.cext=EB_C_UT_SIZE;
   xloc[0]  = 'U';
   xloc[1]  = 'T';
   xloc[2]  = EB_UT_LEN(3);       // length of data part of e.f.
@@ -2791,12 +3128,55 @@ ZRESULT TZip::Add(const TCHAR *odstzn, void *src,unsigned int len, DWORD flags)
   xloc[16] = (char)(times.ctime >> 24);
   memcpy(zfi.cextra,zfi.extra,EB_C_UT_SIZE);
   zfi.cextra[EB_LEN] = EB_UT_LEN(1);
+}
+
+void TZip::keepinfo(TZipFileInfo &zfi)
+{ // Keep a copy of the zipfileinfo, for our end-of-zip directory
+  char *cextra = new char[zfi.cext]; memcpy(cextra,zfi.cextra,zfi.cext); zfi.cextra=cextra;
+  TZipFileInfo *pzfi = new TZipFileInfo; memcpy(pzfi,&zfi,sizeof(zfi));
+  if (zfis==NULL) zfis=pzfi;
+  else {TZipFileInfo *z=zfis; while (z->nxt!=NULL) z=z->nxt; z->nxt=pzfi;}
+}
+
+ZRESULT TZip::Add(const TCHAR *odstzn, void *src,unsigned int len, DWORD flags)
+{ if (oerr) return ZR_FAILED;
+  if (hasputcen) return ZR_ENDED;
+
+  // if we use password encryption, then every isize and csize is 12 bytes bigger
+  int passex=0; if (password!=0 && flags!=ZIP_FOLDER) passex=12;
+
+  // zip has its own notion of what its names should look like: i.e. dir/file.stuff
+  TCHAR dstzn[MAX_PATH]; _tcsncpy(dstzn,odstzn,MAX_PATH); dstzn[MAX_PATH-1]=0;
+  if (*dstzn==0) return ZR_ARGS;
+  TCHAR *d=dstzn; while (*d!=0) {if (*d=='\\') *d='/'; d++;}
+  bool isdir = (flags==ZIP_FOLDER);
+  bool needs_trailing_slash = (isdir && dstzn[_tcslen(dstzn)-1]!='/');
+  int method=DEFLATE; if (isdir || level==0 || HasZipSuffix(dstzn)) method=STORE;
+
+  // now open whatever was our input source:
+  ZRESULT openres;
+  if (flags==ZIP_FILENAME) openres=open_file((const TCHAR*)src);
+  else if (flags==ZIP_HANDLE) openres=open_handle((HANDLE)src,len);
+  else if (flags==ZIP_MEMORY) openres=open_mem(src,len);
+  else if (flags==ZIP_FOLDER) openres=open_dir();
+  else return ZR_ARGS;
+  if (openres!=ZR_OK) return openres;
+  if (!isdir && method==DEFLATE && storepolicy==ZIP_STORE_COMPRESSED)
+  { if (HasCompressedAudioSuffix(dstzn) || ihighentropy()) method=STORE;
+  }
+
+  // A zip "entry" consists of a local header (which includes the file name),
+  // then the compressed data, and possibly an extended local header.
+
+  // Initialize the local header
+  TZipFileInfo zfi; char xloc[EB_L_UT_SIZE], xcen[EB_C_UT_SIZE];
+  initinfo(zfi,dstzn,isdir,needs_trailing_slash,method,passex,xloc,xcen);
 
 
   // (1) Start by writing the local header:
   int r = putlocal(&zfi,swrite,this);
   if (r!=ZE_OK) {iclose(); return ZR_WRITE;}
-  writ += 4 + LOCHEAD + (unsigned int)zfi.nam + (unsigned int)zfi.ext;
+  writ += 4 + LOCHEAD + (unsigned int)zfi.nam + (unsigned int)zfi.ext + (zfi.zip64 ? EB_L_ZIP64_SIZE : 0);
   if (oerr!=ZR_OK) {iclose(); return oerr;}
 
   // (1.5) if necessary, write the encryption header
@@ -2826,6 +3206,8 @@ ZRESULT TZip::Add(const TCHAR *odstzn, void *src,unsigned int len, DWORD flags)
   writ += csize;
   if (oerr!=ZR_OK) return oerr;
   if (writeres!=ZR_OK) return ZR_WRITE;
+  // without a Zip64 field in the local header, the sizes must fit in 32 bits
+  if (!zfi.zip64 && (csize+passex>=ZIP64_LIMIT || (uzoff_t)isize>=ZIP64_LIMIT)) return ZR_MISSIZE;
 
   // (3) Either rewrite the local header with correct information...
   bool first_header_has_size_right = (zfi.siz==csize+passex);
@@ -2846,23 +3228,173 @@ ZRESULT TZip::Add(const TCHAR *odstzn, void *src,unsigned int len, DWORD flags)
     if (zfi.how != (ush) method) return ZR_NOCHANGE;
     if (method==STORE && !first_header_has_size_right) return ZR_NOCHANGE;
     if ((r = putextended(&zfi, swrite,this)) != ZE_OK) return ZR_WRITE;
-    writ += 16L;
+    writ += zfi.zip64 ? 24L : 16L;
     zfi.flg = zfi.lflg; // if flg modified by inflate, for the central index
   }
   if (oerr!=ZR_OK) return oerr;
 
-  // Keep a copy of the zipfileinfo, for our end-of-zip directory
-  char *cextra = new char[zfi.cext]; memcpy(cextra,zfi.cextra,zfi.cext); zfi.cextra=cextra;
-  TZipFileInfo *pzfi = new TZipFileInfo; memcpy(pzfi,&zfi,sizeof(zfi));
-  if (zfis==NULL) zfis=pzfi;
-  else {TZipFileInfo *z=zfis; while (z->nxt!=NULL) z=z->nxt; z->nxt=pzfi;}
+  keepinfo(zfi);
+  return ZR_OK;
+}
+
+ZRESULT TZip::AddRaw(const TCHAR *odstzn, const TCHAR *fn, const void *data, uzoff_t rawsize, ulg rawcrc, int method)
+{ // the item is "fn", but its data is already compressed: it is written as it is
+  if (oerr) return ZR_FAILED;
+  if (hasputcen) return ZR_ENDED;
+  if (password!=0 || data==0 || (method!=STORE && method!=DEFLATE)) return ZR_ARGS;
+  TCHAR dstzn[MAX_PATH]; _tcsncpy(dstzn,odstzn,MAX_PATH); dstzn[MAX_PATH-1]=0;
+  if (*dstzn==0) return ZR_ARGS;
+  TCHAR *d=dstzn; while (*d!=0) {if (*d=='\\') *d='/'; d++;}
+
+  // the input is only opened for its attributes, times and size
+  ZRESULT openres=open_file(fn);
+  if (openres!=ZR_OK) return openres;
+  long long size=isize; iclose(); isize=size;
+  if (isize<0 || (method==STORE && (uzoff_t)isize!=rawsize)) return ZR_MISSIZE;
+
+  TZipFileInfo zfi; char xloc[EB_L_UT_SIZE], xcen[EB_C_UT_SIZE];
+  initinfo(zfi,dstzn,false,false,method,0,xloc,xcen);
+  zfi.crc = rawcrc;
+  zfi.flg = 0; zfi.lflg = 0; // sizes and crc are known: no extended local header
+  zfi.siz = rawsize;
+  zfi.len = (uzoff_t)isize;
+  zfi.zip64 = (rawsize>=ZIP64_LOCAL_LIMIT || (uzoff_t)isize>=ZIP64_LOCAL_LIMIT);
+  if (zfi.zip64) zfi.ver = (ush)45;
+
+  int r = putlocal(&zfi,swrite,this);
+  if (r!=ZE_OK) return ZR_WRITE;
+  writ += 4 + LOCHEAD + (unsigned int)zfi.nam + (unsigned int)zfi.ext + (zfi.zip64 ? EB_L_ZIP64_SIZE : 0);
+  if (oerr!=ZR_OK) return oerr;
+  for (uzoff_t done=0; done<rawsize; )
+  { unsigned int n = (unsigned int)(rawsize-done > 0x40000000 ? 0x40000000 : rawsize-done);
+    if (write((const char*)data+done,n)!=n) return ZR_WRITE;
+    done += n;
+  }
+  writ += rawsize;
+  if (oerr!=ZR_OK) return oerr;
+  keepinfo(zfi);
   return ZR_OK;
 }
 
+ZRESULT TZip::AddPrepared(TZip *prepared)
+{ // "prepared" holds exactly one item, written at its offset 0: local header, data.
+  // Nothing in there depends on where the item is, so it is copied as it is.
+  if (oerr) return ZR_FAILED;
+  if (hasputcen) return ZR_ENDED;
+  TZipFileInfo *zfi = prepared->zfis;
+  if (zfi==NULL || zfi->nxt!=NULL) return ZR_ARGS;
+  unsigned int size = prepared->writ;
+  if (prepared->obuf==0) return ZR_ARGS;
+  if (write(prepared->obuf,size)!=size) return ZR_WRITE;
+  if (oerr!=ZR_OK) return oerr;
+  zfi->off = writ+ooffset;
+  if (zfi->off>=ZIP64_LIMIT) zfi->ver = (ush)45;
+  writ += size;
+  prepared->zfis = NULL;
+  if (zfis==NULL) zfis=zfi;
+  else {TZipFileInfo *z=zfis; while (z->nxt!=NULL) z=z->nxt; z->nxt=zfi;}
+  return ZR_OK;
+}
+
+ZRESULT TZip::AddFiles(int count, const TCHAR * const *dstzn, const TCHAR * const *fn, unsigned int njobs)
+{ if (count<0 || (count>0 && (dstzn==0 || fn==0))) return ZR_ARGS;
+  // big items get all the threads, through ideflate_chunked
+  unsigned int oldjobs=jobs; jobs=njobs;
+  ZRESULT res=AddFilesParallel(count,dstzn,fn);
+  jobs=oldjobs;
+  return res;
+}
+
+ZRESULT TZip::AddFilesParallel(int count, const TCHAR * const *dstzn, const TCHAR * const *fn)
+{ // Encrypted items use random headers, and a non-seekable output gets extended
+  // local headers, so the items can only be added the usual way in these cases.
+  bool parallel = (jobs>1 && count>1 && password==0 && ocanseek);
+#ifndef ZIP_STD
+  parallel = false;
+#endif
+  if (!parallel)
+  { for (int i=0; i<count; i++)
+    { ZRESULT r = (fn[i]!=0) ? Add(dstzn[i],(void*)fn[i],0,ZIP_FILENAME) : Add(dstzn[i],0,0,ZIP_FOLDER);
+      if (r!=ZR_OK) return r;
+    }
+    return ZR_OK;
+  }
+
+#ifdef ZIP_STD
+  // Up to "jobs" items are compressed at the same time, each one into its own zip.
+  // This thread appends them in order, so the result is exactly what Add() gives.
+  // At most 2*jobs compressed items wait to be appended, to bound the memory used.
+  // Big items are not prepared: this thread adds them with ideflate_chunked.
+  struct TPrepared {TZip *zip; ZRESULT res; bool done;};
+  std::vector<TPrepared> prepared(count);
+  for (int i=0; i<count; i++) {prepared[i].zip=0; prepared[i].res=ZR_OK; prepared[i].done=false;}
+  std::mutex mutex; std::condition_variable cond;
+  int next=0, written=0; bool stop=false;
+  const int window = (int)(2*jobs);
+
+  auto worker = [&]()
+  { for (;;)
+    { int i;
+      { std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&]{return stop || next>=count || next<written+window;});
+        if (stop || next>=count) return;
+        i=next++;
+      }
+      TZip *zip=0; ZRESULT r=ZR_OK;
+      struct stat st;
+      if (fn[i]!=0 && !(stat(fn[i],&st)==0 && st.st_size>=ZIP_CHUNK_THRESHOLD)) // folders are added by the writer too
+      { zip = new TZip(0); zip->storepolicy=storepolicy; zip->level=level;
+        r = zip->Create(0,16384,ZIP_MEMORY);
+        if (r==ZR_OK) r = zip->Add(dstzn[i],(void*)fn[i],0,ZIP_FILENAME);
+      }
+      { std::lock_guard<std::mutex> lock(mutex);
+        prepared[i].zip=zip; prepared[i].res=r; prepared[i].done=true;
+      }
+      cond.notify_all();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned int t=0; t<jobs && (int)t<count; t++) threads.push_back(std::thread(worker));
+
+  ZRESULT res=ZR_OK;
+  for (int i=0; i<count && res==ZR_OK; i++)
+  { { std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [&]{return prepared[i].done;});
+    }
+    if (fn[i]==0) res = Add(dstzn[i],0,0,ZIP_FOLDER);
+    else if (prepared[i].res!=ZR_OK) res = prepared[i].res;
+    else if (prepared[i].zip==0) res = Add(dstzn[i],(void*)fn[i],0,ZIP_FILENAME);
+    else res = AddPrepared(prepared[i].zip);
+    { std::lock_guard<std::mutex> lock(mutex);
+      written=i+1;
+      if (res!=ZR_OK) stop=true;
+    }
+    cond.notify_all();
+  }
+  { std::lock_guard<std::mutex> lock(mutex); stop=true; }
+  cond.notify_all();
+  for (size_t t=0; t<threads.size(); t++) threads[t].join();
+
+  for (int i=0; i<count; i++)
+  { TZip *zip = prepared[i].zip;
+    if (zip!=0)
+    { for (TZipFileInfo *zfi=zip->zfis; zfi!=NULL; ) // only if the item was not appended
+      { TZipFileInfo *zfinext=zfi->nxt; if (zfi->cextra!=0) delete[] zfi->cextra; delete zfi; zfi=zfinext;
+      }
+      delete zip;
+    }
+  }
+  return res;
+#else
+  return ZR_ARGS;
+#endif
+}
+
 ZRESULT TZip::AddCentral()
 { // write central directory
-  int numentries = 0;
-  ulg pos_at_start_of_central = writ;
+  uzoff_t numentries = 0;
+  uzoff_t pos_at_start_of_central = writ;
   //ulg tot_unc_size=0, tot_compressed_size=0;
   bool okay=true;
   for (TZipFileInfo *zfi=zfis; zfi!=NULL; )
@@ -2870,7 +3402,7 @@ ZRESULT TZip::AddCentral()
     { int res = putcentral(zfi, swrite,this);
       if (res!=ZE_OK) okay=false;
     }
-    writ += 4 + CENHEAD + (unsigned int)zfi->nam + (unsigned int)zfi->cext + (unsigned int)zfi->com;
+    writ += 4 + CENHEAD + (unsigned int)zfi->nam + (unsigned int)zfi->cext + (unsigned int)zfi->com + (unsigned int)central64size(zfi);
     //tot_unc_size += zfi->len;
     //tot_compressed_size += zfi->siz;
     numentries++;
@@ -2880,9 +3412,16 @@ ZRESULT TZip::AddCentral()
     delete zfi;
     zfi = zfinext;
   }
-  ulg center_size = writ - pos_at_start_of_central;
+  uzoff_t center_size = writ - pos_at_start_of_central;
+  uzoff_t center_offset = pos_at_start_of_central+ooffset;
+  if (okay && (numentries>=0xFFFF || center_size>=ZIP64_LIMIT || center_offset>=ZIP64_LIMIT))
+  { int res = putend64(numentries, center_size, center_offset, writ+ooffset, swrite,this);
+    if (res!=ZE_OK) okay=false;
+    writ += 4 + ZIP64ENDHEAD + 4 + ZIP64LOCHEAD;
+    numentries = 0xFFFF; center_size = ZIP64_LIMIT; center_offset = ZIP64_LIMIT;
+  }
   if (okay)
-  { int res = putend(numentries, center_size, pos_at_start_of_central+ooffset, 0, NULL, swrite,this);
+  { int res = putend((int)numentries, (ulg)center_size, (ulg)center_offset, 0, NULL, swrite,this);
     if (res!=ZE_OK) okay=false;
     writ += 4 + ENDHEAD + 0;
   }
@@ -2894,7 +3433,7 @@ ZRESULT TZip::AddCentral()
 
 
 
-ZRESULT lasterrorZ=ZR_OK;
+thread_local ZRESULT lasterrorZ=ZR_OK; // per thread, as several zips can be made at once
 
 unsigned int FormatZipMessageZ(ZRESULT code, char *buf,unsigned int len)
 { if (code==ZR_RECENT) code=lasterrorZ;
@@ -2939,8 +3478,9 @@ typedef struct
 
 HZIP CreateZipInternal(void *z,unsigned int len,DWORD flags, const char *password)
 { TZip *zip = new TZip(password);
-  lasterrorZ = zip->Create(z,len,flags);
-  if (lasterrorZ!=ZR_OK) {delete zip; return 0;}
+  ZRESULT res = zip->Create(z,len,flags);
+  lasterrorZ=res;
+  if (res!=ZR_OK) {delete zip; return 0;}
   TZipHandleData *han = new TZipHandleData;
   han->flag=2; han->zip=zip; return (HZIP)han;
 }
@@ -2954,24 +3494,59 @@ ZRESULT ZipAddInternal(HZIP hz,const TCHAR *dstzn, void *src,unsigned int len, D
   TZipHandleData *han = (TZipHandleData*)hz;
   if (han->flag!=2) {lasterrorZ=ZR_ZMODE;return ZR_ZMODE;}
   TZip *zip = han->zip;
-  lasterrorZ = zip->Add(dstzn,src,len,flags);
-  return lasterrorZ;
+  ZRESULT res = zip->Add(dstzn,src,len,flags);
+  lasterrorZ=res; return res;
+}
+ZRESULT ZipAddFiles(HZIP hz, int count, const TCHAR * const *dstzn, const TCHAR * const *fn, unsigned int jobs)
+{ if (hz==0) {lasterrorZ=ZR_ARGS;return ZR_ARGS;}
+  TZipHandleData *han = (TZipHandleData*)hz;
+  if (han->flag!=2) {lasterrorZ=ZR_ZMODE;return ZR_ZMODE;}
+  TZip *zip = han->zip;
+  if (zip->oerr) {lasterrorZ=ZR_FAILED;return ZR_FAILED;}
+  ZRESULT res = zip->AddFiles(count,dstzn,fn,jobs);
+  lasterrorZ=res; return res;
 }
 ZRESULT ZipAdd(HZIP hz,const TCHAR *dstzn, const TCHAR *fn) {return ZipAddInternal(hz,dstzn,(void*)fn,0,ZIP_FILENAME);}
 ZRESULT ZipAdd(HZIP hz,const TCHAR *dstzn, void *src,unsigned int len) {return ZipAddInternal(hz,dstzn,src,len,ZIP_MEMORY);}
 ZRESULT ZipAddHandle(HZIP hz,const TCHAR *dstzn, HANDLE h) {return ZipAddInternal(hz,dstzn,h,0,ZIP_HANDLE);}
 ZRESULT ZipAddHandle(HZIP hz,const TCHAR *dstzn, HANDLE h, unsigned int len) {return ZipAddInternal(hz,dstzn,h,len,ZIP_HANDLE);}
 ZRESULT ZipAddFolder(HZIP hz,const TCHAR *dstzn) {return ZipAddInternal(hz,dstzn,0,0,ZIP_FOLDER);}
+ZRESULT ZipAddRaw(HZIP hz,const TCHAR *dstzn, const TCHAR *fn, const void *data, unsigned long long len, unsigned long crc, int method)
+{ if (hz==0) {lasterrorZ=ZR_ARGS;return ZR_ARGS;}
+  TZipHandleData *han = (TZipHandleData*)hz;
+  if (han->flag!=2) {lasterrorZ=ZR_ZMODE;return ZR_ZMODE;}
+  TZip *zip = han->zip;
+  ZRESULT res = zip->AddRaw(dstzn,fn,data,(uzoff_t)len,(ulg)crc,method);
+  lasterrorZ=res; return res;
+}
+
 
 
+ZRESULT ZipSetStorePolicy(HZIP hz, DWORD policy)
+{ if (hz==0) {lasterrorZ=ZR_ARGS;return ZR_ARGS;}
+  TZipHandleData *han = (TZipHandleData*)hz;
+  if (han->flag!=2) {lasterrorZ=ZR_ZMODE;return ZR_ZMODE;}
+  if (policy!=ZIP_STORE_ARCHIVES && policy!=ZIP_STORE_COMPRESSED) {lasterrorZ=ZR_ARGS;return ZR_ARGS;}
+  han->zip->storepolicy = policy;
+  lasterrorZ=ZR_OK; return ZR_OK;
+}
+
+ZRESULT ZipSetLevel(HZIP hz, int level)
+{ if (hz==0) {lasterrorZ=ZR_ARGS;return ZR_ARGS;}
+  TZipHandleData *han = (TZipHandleData*)hz;
+  if (han->flag!=2) {lasterrorZ=ZR_ZMODE;return ZR_ZMODE;}
+  if (level<0 || level>9) {lasterrorZ=ZR_ARGS;return ZR_ARGS;}
+  han->zip->level = level;
+  lasterrorZ=ZR_OK; return ZR_OK;
+}
 
 ZRESULT ZipGetMemory(HZIP hz, void **buf, unsigned long *len)
 { if (hz==0) {if (buf!=0) *buf=0; if (len!=0) *len=0; lasterrorZ=ZR_ARGS;return ZR_ARGS;}
   TZipHandleData *han = (TZipHandleData*)hz;
   if (han->flag!=2) {lasterrorZ=ZR_ZMODE;return ZR_ZMODE;}
   TZip *zip = han->zip;
-  lasterrorZ = zip->GetMemory(buf,len);
-  return lasterrorZ;
+  ZRESULT res = zip->GetMemory(buf,len);
+  lasterrorZ=res; return res;
 }
 
 ZRESULT CloseZipZ(HZIP hz)
@@ -2979,10 +3554,10 @@ ZRESULT CloseZipZ(HZIP hz)
   TZipHandleData *han = (TZipHandleData*)hz;
   if (han->flag!=2) {lasterrorZ=ZR_ZMODE;return ZR_ZMODE;}
   TZip *zip = han->zip;
-  lasterrorZ = zip->Close();
+  ZRESULT res = zip->Close();
   delete zip;
   delete han;
-  return lasterrorZ;
+  lasterrorZ=res; return res;
 }
 
 bool IsZipHandleZ(HZIP hz)
@@ -42,6 +42,7 @@ HZIP CreateZipHandle(HANDLE h, const char *password);
 // in a file (by name):    CreateZip("c:\\test.zip");
 // in memory:              CreateZip(buf, len);
 // or in pagefile memory:  CreateZip(0, len);
+// (with ZIP_STD, the latter is a heap block that grows beyond len as needed)
 // The final case stores it in memory backed by the system paging file,
 // where the zip may not exceed len bytes. This is a bit friendlier than
 // allocating memory with new[]: it won't lead to fragmentation, and the
@@ -85,6 +86,35 @@ ZRESULT ZipAddFolder(HZIP hz,const TCHAR *dstzn);
 // compressed item itself, which in turn makes it easier when unzipping the
 // zipfile from a pipe.
 
+ZRESULT ZipAddRaw(HZIP hz,const TCHAR *dstzn, const TCHAR *fn, const void *data, unsigned long long len, unsigned long crc, int method);
+// ZipAddRaw - adds the file fn as dstzn, but its data is not read nor compressed:
+// the len bytes of data are written as they are, e.g. taken from another zip
+// with GetZipItemRaw. method is 0 if data is stored, 8 if it is deflated, and
+// crc is the crc-32 of the content of fn. Only the attributes, times and size
+// of fn are read; a stored item must have the size of fn. Not for encrypted zips.
+#define ZIP_STORE_ARCHIVES   0   // store archives (.zip, .gz, ...), deflate everything else. This is the default
+#define ZIP_STORE_COMPRESSED 1   // also store compressed audio (.ogg, .flac, .mp3, ...) and high-entropy data
+ZRESULT ZipSetStorePolicy(HZIP hz, DWORD policy);
+// ZipSetStorePolicy - decides which items are stored as they are instead of being deflated.
+// It applies to the items added after the call. With ZIP_STORE_COMPRESSED, an item
+// whose name has no known suffix is stored if its first 16 KiB look incompressible:
+// their order-0 entropy (byte frequencies only) is high, and a level-1 deflate of them
+// saves less than 3% (the item must come from memory, from a file, or from a seekable handle).
+
+#define ZIP_DEFAULT_LEVEL 8
+ZRESULT ZipSetLevel(HZIP hz, int level);
+// ZipSetLevel - sets the deflate level of the items added after the call:
+// from 1 (fastest) to 9 (smallest), ZIP_DEFAULT_LEVEL if it is never called.
+// Level 0 stores every item without compressing it.
+
+ZRESULT ZipAddFiles(HZIP hz, int count, const TCHAR * const *dstzn, const TCHAR * const *fn, unsigned int jobs);
+// ZipAddFiles - same as calling ZipAdd(hz,dstzn[i],fn[i]) for each i in order,
+// or ZipAddFolder(hz,dstzn[i]) if fn[i] is null. Up to "jobs" files are
+// compressed at the same time, into memory, and they are written in order, so the
+// zip is the same as with jobs=1. A big file (64Mb or more) is instead cut in pieces
+// that are compressed at the same time; its data is a bit bigger than with jobs=1.
+// Files are added one at a time if the zip is encrypted or is not seekable.
+
 ZRESULT ZipGetMemory(HZIP hz, void **buf, unsigned long *len);
 // ZipGetMemory - If the zip was created in memory, via ZipCreate(0,len),
 // then this function will return information about that memory block.
@@ -0,0 +1,189 @@
+/*
+*   LMMS Project Packager
+*   Copyright © 2022 Luxon Jean-Pierre
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "packager.hpp"
+#include "options.hpp"
+#include "workers.hpp"
+#include "../program/printer.hpp"
+#include "../exceptions/exceptions.hpp"
+#include "../external/filesystem/filesystem.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <numeric>
+#include <mutex>
+#include <map>
+#include <vector>
+
+using namespace exceptions;
+namespace fsys = ghc::filesystem;
+
+namespace Packager
+{
+
+namespace
+{
+
+struct BatchEntry
+{
+    std::string project_file;
+    std::string destination_directory;
+};
+
+// A relative path of the manifest is relative to the directory of the manifest
+const std::string manifestPath( const fsys::path& manifest_directory, const std::string& path )
+{
+    const fsys::path p( path );
+    return fsys::normalize( ( p.is_absolute() ? p : manifest_directory / p ).lexically_normal().string() );
+}
+
+/*
+    Read the (project, target) pairs of the manifest, one per line, separated by a tab
+    (or by the first spaces if there is no tab). Empty lines and lines starting with '#' are ignored.
+    Two projects cannot be exported into the same target directory.
+*/
+const std::vector<BatchEntry> readManifest( const std::string& manifest )
+{
+    std::ifstream infile( manifest );
+    if ( !infile )
+    {
+        throw NonExistingFileException( "ERROR: Cannot read the manifest \"" + manifest + "\".\n" );
+    }
+
+    const fsys::path manifest_directory = fsys::path( manifest ).parent_path();
+    std::vector<BatchEntry> entries;
+    std::map<std::string, unsigned int> target_lines;
+    std::string line;
+    unsigned int line_number = 0;
+
+    while ( std::getline( infile, line ) )
+    {
+        line_number++;
+        if ( !line.empty() && line.back() == '\r' )
+        {
+            line.pop_back();
+        }
+
+        const std::size_t first = line.find_first_not_of( " \t" );
+        if ( first == std::string::npos || line[first] == '#' )
+        {
+            continue;
+        }
+
+        const std::size_t tab = line.find( '\t', first );
+        const std::size_t sep = ( tab != std::string::npos ) ? tab : line.find( ' ', first );
+        const std::size_t target = ( sep != std::string::npos ) ? line.find_first_not_of( " \t", sep ) : std::string::npos;
+        if ( target == std::string::npos )
+        {
+            throw PackageExportException( "ERROR: \"" + manifest + "\", line " + std::to_string( line_number )
+                                          + ": a project and its target directory are expected.\n" );
+        }
+
+        const std::string& project = line.substr( first, line.find_last_not_of( " \t", sep ) + 1 - first );
+        const std::string& destination = line.substr( target, line.find_last_not_of( " \t" ) + 1 - target );
+        std::string destination_directory = manifestPath( manifest_directory, destination );
+        if ( destination_directory.back() != '/' )
+        {
+            destination_directory += '/';
+        }
+
+        const auto& previous = target_lines.emplace( destination_directory, line_number );
+        if ( !previous.second )
+        {
+            throw PackageExportException( "ERROR: \"" + manifest + "\", line " + std::to_string( line_number )
+                                          + ": the target directory is already used line " + std::to_string( previous.first->second ) + ".\n" );
+        }
+        entries.push_back( BatchEntry{ manifestPath( manifest_directory, project ), destination_directory } );
+    }
+    return entries;
+}
+
+}
+
+/*
+    The projects are exported on one pool of "jobs" threads, the biggest project files first so that
+    a long export does not end the batch alone. The threads left when there are fewer projects than jobs
+    are given to the exports. The resource index and the content hashes are shared by all the exports.
+    An export that fails does not stop the other ones.
+*/
+bool batchPack( const options::Options& options )
+{
+    const std::vector<BatchEntry>& entries = readManifest( options.project_file );
+    const options::ExportOptions& opt = options.export_opt;
+    const unsigned int export_jobs = std::max<unsigned int>( 1, opt.jobs / std::max<std::size_t>( 1, entries.size() ) );
+    program::log::Printer print = program::log::getPrinter();
+
+    std::vector<std::uintmax_t> sizes;
+    for ( const BatchEntry& entry : entries )
+    {
+        std::error_code ec;
+        const std::uintmax_t size = fsys::file_size( entry.project_file, ec );
+        sizes.push_back( ec ? 0 : size );
+    }
+
+    std::vector<std::size_t> order( entries.size() );
+    std::iota( order.begin(), order.end(), 0 );
+    std::stable_sort( order.begin(), order.end(), [&sizes] ( const std::size_t a, const std::size_t b )
+    {
+        return sizes[a] > sizes[b];
+    } );
+
+    print << "-- Batch: " << static_cast<long>( entries.size() ) << " project(s) to export.\n";
+
+    std::mutex output_mutex;
+    std::vector<std::string> errors( entries.size() );
+    workers::runParallel( order.size(), opt.jobs, [&] ( const std::size_t i )
+    {
+        const BatchEntry& entry = entries[order[i]];
+        const options::ExportOptions export_opt { opt.sf2_export, opt.zip, opt.resource_directories, opt.lmms_command,
+                                                  export_jobs, opt.stream, opt.store_compressed, opt.level, opt.resource_index };
+        const options::Options job { options::OperationType::Pack, entry.project_file, entry.destination_directory,
+                                     options.verbose, export_opt };
+        std::string report;
+        try
+        {
+            report = "-- LMMS project exported into \"" + pack( job ) + "\"\n";
+        }
+        catch ( std::exception& e )
+        {
+            errors[order[i]] = e.what();
+            report = "-- FAILED: \"" + entry.project_file + "\"\n" + errors[order[i]];
+        }
+
+        const std::lock_guard<std::mutex> lock( output_mutex );
+        std::cout << report;
+    } );
+
+    const std::size_t failures = std::count_if( errors.cbegin(), errors.cend(), [] ( const std::string& e )
+    {
+        return !e.empty();
+    } );
+
+    std::cout << "\n-- Batch: " << entries.size() - failures << " project(s) exported, " << failures << " failed.\n";
+    for ( std::size_t i = 0; i < entries.size(); i++ )
+    {
+        if ( !errors[i].empty() )
+        {
+            std::cout << "*  " << entries[i].project_file << " -> " << entries[i].destination_directory << "\n";
+        }
+    }
+    return failures == 0;
+}
+
+}
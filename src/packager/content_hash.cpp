@@ -0,0 +1,232 @@
+/*
+*   LMMS Project Packager
+*   Copyright © 2022 Luxon Jean-Pierre
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "content_hash.hpp"
+#include "../exceptions/exceptions.hpp"
+#include "../external/filesystem/filesystem.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+
+using namespace exceptions;
+
+namespace content
+{
+
+namespace
+{
+
+const std::uint64_t C1 = 0x87c37b91114253d5ULL;
+const std::uint64_t C2 = 0x4cf5af49729f6d61ULL;
+// Multiple of the block size (16 bytes), so only the last read can end with a partial block
+const std::size_t READ_SIZE = 1 << 16;
+
+std::uint64_t rotl( const std::uint64_t x, const int r ) noexcept
+{
+    return ( x << r ) | ( x >> ( 64 - r ) );
+}
+
+std::uint64_t fmix( std::uint64_t k ) noexcept
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// Little-endian load, whatever the byte order of the machine
+std::uint64_t load( const unsigned char * p, const std::size_t size ) noexcept
+{
+    std::uint64_t k = 0;
+    for ( std::size_t i = size; i > 0; i-- )
+    {
+        k = ( k << 8 ) | p[i - 1];
+    }
+    return k;
+}
+
+std::uint64_t mixK1( std::uint64_t k1 ) noexcept
+{
+    return rotl( k1 * C1, 31 ) * C2;
+}
+
+std::uint64_t mixK2( std::uint64_t k2 ) noexcept
+{
+    return rotl( k2 * C2, 33 ) * C1;
+}
+
+/*
+    Mix the "n" bytes of "data" into the hash. Only the last data of a content
+    can end with a partial block (less than 16 bytes).
+*/
+void mixBlocks( const unsigned char * data, const std::size_t n, std::uint64_t& h1, std::uint64_t& h2 ) noexcept
+{
+    const std::size_t blocks = n / 16;
+    const std::size_t tail = n % 16;
+
+    for ( std::size_t i = 0; i < blocks; i++ )
+    {
+        h1 ^= mixK1( load( data + i * 16, 8 ) );
+        h1 = ( rotl( h1, 27 ) + h2 ) * 5 + 0x52dce729;
+        h2 ^= mixK2( load( data + i * 16 + 8, 8 ) );
+        h2 = ( rotl( h2, 31 ) + h1 ) * 5 + 0x38495ab5;
+    }
+
+    if ( tail != 0 )
+    {
+        const unsigned char * p = data + blocks * 16;
+        if ( tail > 8 )
+        {
+            h2 ^= mixK2( load( p + 8, tail - 8 ) );
+        }
+        h1 ^= mixK1( load( p, tail > 8 ? 8 : tail ) );
+    }
+}
+
+Hash finalHash( std::uint64_t h1, std::uint64_t h2, const std::uint64_t length ) noexcept
+{
+    h1 ^= length;
+    h2 ^= length;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix( h1 );
+    h2 = fmix( h2 );
+    h1 += h2;
+    h2 += h1;
+    return Hash{ h1, h2 };
+}
+
+Hash readHash( const std::string& file )
+{
+    std::ifstream infile( file, std::ios::binary );
+    if ( !infile )
+    {
+        throw PackageExportException( "ERROR: Cannot read \"" + ghc::filesystem::normalize( file ) + "\".\n" );
+    }
+
+    std::vector<unsigned char> buffer( READ_SIZE );
+    std::uint64_t h1 = 0;
+    std::uint64_t h2 = 0;
+    std::uint64_t length = 0;
+
+    while ( infile )
+    {
+        infile.read( reinterpret_cast<char *>( buffer.data() ), buffer.size() );
+        const std::size_t n = static_cast<std::size_t>( infile.gcount() );
+        length += n;
+        mixBlocks( buffer.data(), n, h1, h2 );
+    }
+
+    if ( infile.bad() )
+    {
+        throw PackageExportException( "ERROR: Cannot read \"" + ghc::filesystem::normalize( file ) + "\".\n" );
+    }
+
+    return finalHash( h1, h2, length );
+}
+
+}
+
+Hash dataHash( const void * data, const std::size_t size ) noexcept
+{
+    std::uint64_t h1 = 0;
+    std::uint64_t h2 = 0;
+    mixBlocks( static_cast<const unsigned char *>( data ), size, h1, h2 );
+    return finalHash( h1, h2, size );
+}
+
+void Hasher::update( const void * data, std::size_t size ) noexcept
+{
+    const unsigned char * p = static_cast<const unsigned char *>( data );
+    length += size;
+
+    if ( pending_size > 0 )
+    {
+        const std::size_t n = std::min( size, sizeof( pending ) - pending_size );
+        std::memcpy( pending + pending_size, p, n );
+        pending_size += n;
+        p += n;
+        size -= n;
+        if ( pending_size < sizeof( pending ) )
+        {
+            return;
+        }
+        mixBlocks( pending, sizeof( pending ), h1, h2 );
+        pending_size = 0;
+    }
+
+    // Only whole blocks are mixed, the tail waits for the next part
+    const std::size_t whole = size - size % sizeof( pending );
+    mixBlocks( p, whole, h1, h2 );
+    std::memcpy( pending, p + whole, size - whole );
+    pending_size = size - whole;
+}
+
+Hash Hasher::hash() const noexcept
+{
+    std::uint64_t k1 = h1;
+    std::uint64_t k2 = h2;
+    mixBlocks( pending, pending_size, k1, k2 );
+    return finalHash( k1, k2, length );
+}
+
+Hash fileHash( const std::string& file )
+{
+    // A file is only hashed once per run, as long as its size and modification time are the same
+    struct Entry
+    {
+        std::uintmax_t size;
+        ghc::filesystem::file_time_type mtime;
+        Hash hash;
+    };
+    static std::mutex mutex;
+    static std::unordered_map<std::string, Entry> cache;
+
+    std::error_code ec;
+    const std::uintmax_t size = ghc::filesystem::file_size( file, ec );
+    const ghc::filesystem::file_time_type mtime = ec ? ghc::filesystem::file_time_type() :
+                                                  ghc::filesystem::last_write_time( file, ec );
+    if ( ec )
+    {
+        return readHash( file );
+    }
+
+    const std::string& key = ghc::filesystem::absolute( file ).string();
+
+    {
+        const std::lock_guard<std::mutex> lock( mutex );
+        const auto& found = cache.find( key );
+        if ( found != cache.cend() && found->second.size == size && found->second.mtime == mtime )
+        {
+            return found->second.hash;
+        }
+    }
+
+    const Hash hash = readHash( file );
+    const std::lock_guard<std::mutex> lock( mutex );
+    cache[key] = Entry{ size, mtime, hash };
+    return hash;
+}
+
+}
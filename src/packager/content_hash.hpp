@@ -0,0 +1,65 @@
+/*
+*   LMMS Project Packager
+*   Copyright © 2022 Luxon Jean-Pierre
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CONTENT_HASH_HPP_INCLUDED
+#define CONTENT_HASH_HPP_INCLUDED
+
+#include <cstdint>
+#include <string>
+
+namespace content
+{
+
+// 128-bit hash of a content
+struct Hash
+{
+    std::uint64_t low = 0;
+    std::uint64_t high = 0;
+};
+
+/**
+    Hash of the content of a file (MurmurHash3, x64 128-bit variant, seed 0), read by blocks
+    so that a file of any size is hashed in constant memory.
+    It is a fast hash to tell identical files apart, not a cryptographic one.
+    The hashes are cached for the whole run, and shared between threads: a file is read again
+    only if its size or its modification time has changed.
+    Throw PackageExportException if the file cannot be read.
+*/
+Hash fileHash( const std::string& file );
+
+// Hash of a content in memory, the same as fileHash() of a file that has this content
+Hash dataHash( const void * data, const std::size_t size ) noexcept;
+
+// Hash of a content given part by part, in parts of any size: the same as dataHash() of the whole content
+class Hasher final
+{
+private:
+    std::uint64_t h1 = 0;
+    std::uint64_t h2 = 0;
+    std::uint64_t length = 0;
+    unsigned char pending[16];          // the start of a block that is not complete yet
+    std::size_t pending_size = 0;
+
+public:
+    void update( const void * data, std::size_t size ) noexcept;
+    Hash hash() const noexcept;
+};
+
+}
+
+#endif // CONTENT_HASH_HPP_INCLUDED
@@ -0,0 +1,462 @@
+/*
+*   LMMS Project Packager
+*   Copyright © 2022 Luxon Jean-Pierre
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "delta.hpp"
+#include "mmpz.hpp"
+#include "workers.hpp"
+#include "../program/printer.hpp"
+#include "../exceptions/exceptions.hpp"
+#include "../external/filesystem/filesystem.hpp"
+#include "../external/zutils/zutils.hpp"
+
+#include <map>
+#include <set>
+#include <memory>
+#include <sstream>
+#include <cstdio>
+
+using namespace exceptions;
+namespace fsys = ghc::filesystem;
+
+namespace delta
+{
+
+const std::string DESCRIPTOR_ENTRY( "delta" );
+
+namespace
+{
+
+const std::string DESCRIPTOR_HEADER( "lmms-pkg delta 1" );
+
+// A package opened for reading, closed when it goes out of scope
+struct Reader final
+{
+    const HZIP zip;
+
+    explicit Reader( const std::string& package ) : zip( OpenZipMapped( package.c_str(), nullptr ) ) {}
+    Reader( const Reader& ) = delete;
+    Reader& operator =( const Reader& ) = delete;
+    ~Reader()
+    {
+        if ( zip != nullptr )
+        {
+            CloseZip( zip );
+        }
+    }
+};
+
+// The entries of a package by their path in the root directory ("<name>/") of the package
+struct PackageEntries
+{
+    std::string root;
+    std::map<std::string, ZIPENTRY> entries;
+};
+
+const std::string hexHash( const content::Hash& hash )
+{
+    char text[33];
+    std::snprintf( text, sizeof( text ), "%016llx%016llx", static_cast<unsigned long long>( hash.high ),
+                   static_cast<unsigned long long>( hash.low ) );
+    return std::string( text );
+}
+
+bool parseHash( const std::string& text, content::Hash& hash )
+{
+    if ( text.size() != 32 || text.find_first_not_of( "0123456789abcdef" ) != std::string::npos )
+    {
+        return false;
+    }
+    hash.high = std::stoull( text.substr( 0, 16 ), nullptr, 16 );
+    hash.low = std::stoull( text.substr( 16 ), nullptr, 16 );
+    return true;
+}
+
+bool sameHash( const content::Hash& a, const content::Hash& b ) noexcept
+{
+    return a.low == b.low && a.high == b.high;
+}
+
+using HashKey = std::pair<std::uint64_t, std::uint64_t>;
+
+HashKey hashKey( const content::Hash& hash ) noexcept
+{
+    return HashKey( hash.high, hash.low );
+}
+
+const PackageEntries packageEntries( HZIP zip )
+{
+    ZIPENTRY ze;
+    GetZipItem( zip, -1, &ze );
+    const int numitems = ze.index;
+
+    PackageEntries package;
+    for ( int index = 0; index < numitems; index++ )
+    {
+        ZIPENTRY entry;
+        GetZipItem( zip, index, &entry );
+        const std::string& name = entry.name;
+        if ( package.root.empty() )
+        {
+            package.root = name.substr( 0, name.find( '/' ) + 1 );
+        }
+        package.entries[lmms::packagePath( name )] = entry;
+    }
+    return package;
+}
+
+/*
+    Give the content of an entry: a view into the mapped package if the entry is stored,
+    or else the entry unzipped into "buffer". An entry over 4 Gio cannot be unzipped in memory.
+*/
+bool readEntry( HZIP zip, const ZIPENTRY& entry, std::unique_ptr<char []>& buffer, const char *& content, std::size_t& size )
+{
+    const void * view = nullptr;
+    long long view_size = 0;
+    if ( GetZipItemView( zip, entry.index, &view, &view_size ) == ZR_OK )
+    {
+        content = static_cast<const char *>( view );
+        size = static_cast<std::size_t>( view_size );
+        return true;
+    }
+
+    if ( entry.unc_size < 0 || entry.unc_size > 0xFFFFFFFFLL )
+    {
+        return false;
+    }
+
+    size = static_cast<std::size_t>( entry.unc_size );
+    buffer.reset( new char[size + 1] );
+    content = buffer.get();
+    return size == 0 || UnzipItem( zip, entry.index, buffer.get(), static_cast<unsigned int>( size ) ) == ZR_OK;
+}
+
+/*
+    Descriptor format, one record per line and tab-separated fields:
+
+        lmms-pkg delta 1
+        B   <base hash>   <base filename>
+        N   <hash>        <path of a resource in the package>
+        K   <hash>        <path of a resource taken from the base>   <path of the resource in the base>
+*/
+bool parseDescriptor( const std::string& text, Descriptor& descriptor )
+{
+    std::istringstream lines( text );
+    std::string line;
+    bool has_base = false;
+
+    if ( !std::getline( lines, line ) || line != DESCRIPTOR_HEADER )
+    {
+        return false;
+    }
+
+    while ( std::getline( lines, line ) )
+    {
+        if ( line.empty() )
+        {
+            continue;
+        }
+
+        const std::size_t first_tab = line.find( '\t' );
+        const std::size_t second_tab = ( first_tab == std::string::npos ) ? first_tab : line.find( '\t', first_tab + 1 );
+
+        content::Hash hash;
+        if ( second_tab == std::string::npos || !parseHash( line.substr( first_tab + 1, second_tab - first_tab - 1 ), hash ) )
+        {
+            return false;
+        }
+
+        const std::string& kind = line.substr( 0, first_tab );
+        const std::string& name = line.substr( second_tab + 1 );
+        if ( kind == "B" )
+        {
+            descriptor.base_hash = hash;
+            descriptor.base_name = name;
+            has_base = true;
+        }
+        else if ( kind == "N" || kind == "K" )
+        {
+            const std::size_t third_tab = name.find( '\t' );
+            if ( ( kind == "K" ) != ( third_tab != std::string::npos ) )
+            {
+                return false;
+            }
+            descriptor.resources.push_back( Resource{ name.substr( 0, third_tab ), hash, kind == "N",
+                                                      kind == "K" ? name.substr( third_tab + 1 ) : "" } );
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return has_base;
+}
+
+bool readDescriptor( HZIP zip, const PackageEntries& package, Descriptor& descriptor, const std::string& package_name )
+{
+    const auto& found = package.entries.find( DESCRIPTOR_ENTRY );
+    if ( found == package.entries.cend() )
+    {
+        return false;
+    }
+
+    std::unique_ptr<char []> buffer;
+    const char * content = nullptr;
+    std::size_t size = 0;
+    if ( !readEntry( zip, found->second, buffer, content, size ) || !parseDescriptor( std::string( content, size ), descriptor ) )
+    {
+        throw PackageImportException( "ERROR: Invalid delta descriptor in \"" + fsys::normalize( package_name ) + "\".\n" );
+    }
+    return true;
+}
+
+}
+
+bool readDescriptor( const std::string& package, Descriptor& descriptor )
+{
+    const Reader reader( package );
+    if ( reader.zip == nullptr )
+    {
+        throw PackageImportException( "ERROR: Cannot read \"" + fsys::normalize( package ) + "\".\n" );
+    }
+    return readDescriptor( reader.zip, packageEntries( reader.zip ), descriptor, package );
+}
+
+const std::string descriptorContent( const Descriptor& descriptor )
+{
+    std::string text = DESCRIPTOR_HEADER + "\n";
+    text += "B\t" + hexHash( descriptor.base_hash ) + "\t" + descriptor.base_name + "\n";
+    for ( const Resource& resource : descriptor.resources )
+    {
+        text += ( resource.in_package ? "N\t" : "K\t" ) + hexHash( resource.hash ) + "\t" + resource.path;
+        text += ( resource.in_package ? "" : "\t" + resource.base_path ) + "\n";
+    }
+    return text;
+}
+
+const Descriptor compareWithBase( const std::string& base_package, const std::vector<std::string>& paths,
+                                  const std::vector<std::string>& files, const unsigned int jobs )
+{
+    program::log::Printer print = program::log::getPrinter();
+    Descriptor descriptor;
+    descriptor.base_hash = content::fileHash( base_package );
+    descriptor.base_name = fsys::path( base_package ).filename().string();
+
+    std::vector<content::Hash> hashes( files.size() );
+    workers::runParallel( files.size(), jobs, [&] ( const std::size_t i )
+    {
+        hashes[i] = content::fileHash( files[i] );
+    } );
+
+    const Reader base( base_package );
+    if ( base.zip == nullptr )
+    {
+        throw PackageExportException( "ERROR: Cannot read the base package \"" + fsys::normalize( base_package ) + "\".\n" );
+    }
+
+    // The resources of the base by content hash: a delta base already knows the hashes of all its resources,
+    // a full one has its entries hashed, but only the ones that have the size of a resource of the project
+    const PackageEntries& base_entries = packageEntries( base.zip );
+    Descriptor base_descriptor;
+    std::map<HashKey, std::string> base_paths;
+    if ( readDescriptor( base.zip, base_entries, base_descriptor, base_package ) )
+    {
+        for ( const Resource& resource : base_descriptor.resources )
+        {
+            base_paths.emplace( hashKey( resource.hash ), resource.path );
+        }
+    }
+    else
+    {
+        std::set<long long> sizes;
+        for ( const std::string& file : files )
+        {
+            std::error_code ec;
+            const auto size = fsys::file_size( file, ec );
+            if ( !ec )
+            {
+                sizes.insert( static_cast<long long>( size ) );
+            }
+        }
+
+        for ( const auto& entry : base_entries.entries )
+        {
+            content::Hash hash;
+            if ( !entry.first.empty() && entry.first.back() != '/' && sizes.count( entry.second.unc_size ) > 0 &&
+                 lmms::entryHash( base.zip, entry.second.index, hash ) )
+            {
+                base_paths.emplace( hashKey( hash ), entry.first );
+            }
+        }
+    }
+
+    for ( std::size_t i = 0; i < paths.size(); i++ )
+    {
+        const auto& found = base_paths.find( hashKey( hashes[i] ) );
+        const bool in_base = found != base_paths.cend();
+        if ( in_base && found->second == paths[i] )
+        {
+            print << "-- \"" << paths[i] << "\" is unchanged since the base package.\n";
+        }
+        else if ( in_base )
+        {
+            print << "-- \"" << paths[i] << "\" is in the base package as \"" << found->second << "\".\n";
+        }
+        descriptor.resources.push_back( Resource{ paths[i], hashes[i], !in_base, in_base ? found->second : "" } );
+    }
+    return descriptor;
+}
+
+const ghc::filesystem::path unzipChain( const std::vector<std::string>& packages, const ghc::filesystem::path& directory,
+                                        const unsigned int jobs )
+{
+    program::log::Printer print = program::log::getPrinter();
+    std::vector<PackageEntries> chain;
+    std::vector<std::map<std::string, std::string> > base_paths( packages.size() );
+    Descriptor last;
+
+    for ( std::size_t i = 0; i < packages.size(); i++ )
+    {
+        const Reader reader( packages[i] );
+        if ( reader.zip == nullptr )
+        {
+            throw PackageImportException( "ERROR: Cannot read \"" + fsys::normalize( packages[i] ) + "\".\n" );
+        }
+
+        chain.push_back( packageEntries( reader.zip ) );
+        Descriptor descriptor;
+        const bool is_delta = readDescriptor( reader.zip, chain.back(), descriptor, packages[i] );
+
+        if ( i == 0 && is_delta )
+        {
+            throw PackageImportException( "ERROR: \"" + fsys::normalize( packages[i] ) + "\" is a delta package of \""
+                                          + descriptor.base_name + "\". The chain must start with a full package.\n" );
+        }
+
+        if ( i > 0 && !is_delta )
+        {
+            throw PackageImportException( "ERROR: \"" + fsys::normalize( packages[i] ) + "\" is not a delta package.\n" );
+        }
+
+        if ( i > 0 && !sameHash( descriptor.base_hash, content::fileHash( packages[i - 1] ) ) )
+        {
+            throw PackageImportException( "ERROR: \"" + fsys::normalize( packages[i] ) + "\" was made against \""
+                                          + descriptor.base_name + "\", not against \"" + fsys::normalize( packages[i - 1] ) + "\".\n" );
+        }
+        for ( const Resource& resource : descriptor.resources )
+        {
+            if ( !resource.in_package )
+            {
+                base_paths[i][resource.path] = resource.base_path;
+            }
+        }
+        last = descriptor;
+    }
+
+    // Everything comes from the last package, except the resources it takes from its base,
+    // which are looked for under their path in the base, that can take them from its own base
+    const std::string& root = chain.back().root;
+    std::vector<std::vector<int> > indices( packages.size() );
+    std::vector<std::vector<std::string> > names( packages.size() );
+    std::vector<std::vector<content::Hash> > hashes( packages.size() );
+    fsys::path project_path( directory );
+
+    for ( const auto& entry : chain.back().entries )
+    {
+        if ( entry.first != DESCRIPTOR_ENTRY )
+        {
+            indices.back().push_back( entry.second.index );
+            names.back().push_back( root + entry.first );
+            if ( fsys::hasExtension( fsys::path( entry.first ), ".mmp" ) )
+            {
+                project_path /= fsys::path( root + entry.first );
+            }
+        }
+    }
+
+    for ( const Resource& resource : last.resources )
+    {
+        if ( resource.in_package )
+        {
+            continue;
+        }
+
+        std::string path = resource.base_path;
+        std::size_t i = packages.size() - 1;
+        while ( i > 0 && chain[i - 1].entries.count( path ) == 0 && base_paths[i - 1].count( path ) > 0 )
+        {
+            path = base_paths[i - 1].at( path );
+            i--;
+        }
+
+        if ( i == 0 || chain[i - 1].entries.count( path ) == 0 )
+        {
+            throw PackageImportException( "ERROR: \"" + resource.path + "\" is in none of the packages of the chain.\n" );
+        }
+        indices[i - 1].push_back( chain[i - 1].entries.at( path ).index );
+        names[i - 1].push_back( root + resource.path );
+        hashes[i - 1].push_back( resource.hash );
+    }
+
+    // The resources from the base packages are checked against the hashes of the delta before anything
+    // is extracted, so that a wrong chain does not leave a partial project
+    std::vector<std::pair<std::size_t, std::size_t> > checks;
+    for ( std::size_t i = 0; i < hashes.size(); i++ )
+    {
+        for ( std::size_t k = 0; k < hashes[i].size(); k++ )
+        {
+            checks.emplace_back( i, k );
+        }
+    }
+
+    workers::runParallel( checks.size(), jobs, [&] ( const std::size_t c )
+    {
+        const std::size_t i = checks[c].first;
+        const std::size_t k = checks[c].second;
+        const Reader reader( packages[i] );
+        content::Hash hash;
+        if ( reader.zip == nullptr || !lmms::entryHash( reader.zip, indices[i][k], hash ) || !sameHash( hash, hashes[i][k] ) )
+        {
+            throw PackageImportException( "ERROR: \"" + lmms::packagePath( names[i][k] )
+                                          + "\" does not have the content expected by the delta package.\n" );
+        }
+    } );
+
+    for ( std::size_t i = 0; i < packages.size(); i++ )
+    {
+        for ( const std::string& name : names[i] )
+        {
+            const fsys::path target( directory / fsys::path( name ) );
+            if ( name.back() != '/' && fsys::exists( target ) )
+            {
+                throw AlreadyExistingFileException( "ERROR: \"" + fsys::normalize( target.string() )
+                                                    + "\" already exists. You need to unpack into another directory.\n" );
+            }
+            print << "-- Extract \"" << name << "\" from \"" << fsys::normalize( packages[i] ) << "\".\n";
+        }
+    }
+
+    // The last package first: it has the directory entries
+    for ( std::size_t i = packages.size(); i > 0; i-- )
+    {
+        lmms::unzipEntries( fsys::path( packages[i - 1] ), directory, indices[i - 1], names[i - 1], jobs );
+    }
+
+    return project_path;
+}
+
+}
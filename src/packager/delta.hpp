@@ -0,0 +1,89 @@
+/*
+*   LMMS Project Packager
+*   Copyright © 2022 Luxon Jean-Pierre
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DELTA_HPP_INCLUDED
+#define DELTA_HPP_INCLUDED
+
+#include "content_hash.hpp"
+
+#include <string>
+#include <vector>
+
+namespace ghc
+{
+namespace filesystem
+{
+class path;
+}
+}
+
+/**
+    Delta packages: a version of a project packaged against a previous package (its base).
+
+    A delta package is a regular package that only has the resources that are new or that changed
+    since the base, plus a descriptor entry ("<name>/delta") with the content hash of the base package
+    and the content hash of every resource of the project. A delta can be the base of another delta,
+    so a chain starts with a full package followed by deltas, each one made against the previous one.
+*/
+namespace delta
+{
+
+extern const std::string DESCRIPTOR_ENTRY;
+
+struct Resource
+{
+    std::string path;           // in the root directory of the package: "resources/<file>"
+    content::Hash hash;
+    bool in_package;            // false if the resource is taken from the base
+    std::string base_path;      // if it is taken from the base: its path in the base, whatever its path here
+};
+
+struct Descriptor
+{
+    content::Hash base_hash;
+    std::string base_name;      // filename of the base package, for information
+    std::vector<Resource> resources;
+};
+
+/*
+    Read the descriptor of the package into "descriptor". Return false if the package is a full package.
+    Throw PackageImportException if the descriptor cannot be read.
+*/
+bool readDescriptor( const std::string& package, Descriptor& descriptor );
+const std::string descriptorContent( const Descriptor& descriptor );
+
+/*
+    Compare the resources of a project (paths in the root directory of the package, and files they come from)
+    with the ones of the base package, by content hash: a resource the base has under another path is found too.
+    Return the descriptor of the delta package, where the resources the base already has are not in the package.
+*/
+const Descriptor compareWithBase( const std::string& base_package, const std::vector<std::string>& paths,
+                                  const std::vector<std::string>& files, const unsigned int jobs );
+
+/*
+    Extract a chain of packages into "directory", like a full package named after the last one
+    (the project file comes from the last one, every resource taken from a base from the entry of that base
+    or of an earlier package that has its content).
+    Return the path of the extracted project file.
+*/
+const ghc::filesystem::path unzipChain( const std::vector<std::string>& packages, const ghc::filesystem::path& directory,
+                                        const unsigned int jobs );
+
+}
+
+#endif // DELTA_HPP_INCLUDED
@@ -23,8 +23,10 @@
 
 struct ExportedFile
 {
-    const ghc::filesystem::path source;
-    const ghc::filesystem::path dest;
+    const ghc::filesystem::path source;     // path written in the project file
+    const ghc::filesystem::path dest;       // name of the file in the resource directory of the package
+    const ghc::filesystem::path location;   // where the file actually is (it can be in a resource directory)
+    const bool duplicate = false;           // same content as a previous file, that is stored once under the same dest
     ~ExportedFile() {};
 };
 #endif // EXPORTED_FILE_HPP_INCLUDED
@@ -18,19 +18,28 @@
 
 #include "mmpz.hpp"
 #include "xml.hpp"
+#include "exported_file.hpp"
+#include "options.hpp"
+#include "workers.hpp"
+#include "delta.hpp"
+#include "content_hash.hpp"
 #include "../program/printer.hpp"
 #include "../exceptions/exceptions.hpp"
 #include "../external/filesystem/filesystem.hpp"
 #include "../external/zutils/zutils.hpp"
+#include "../external/zutils/crc32.h"
 
 #include <iostream>
 #include <memory>
 #include <vector>
 #include <string>
+#include <map>
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <numeric>
 #include <system_error>
+#include <chrono>
 
 using namespace exceptions;
 
@@ -38,6 +47,90 @@ namespace lmms
 {
 const std::string PACKAGE_EXTENSION( ".mmpk" );
 
+namespace
+{
+
+/*
+    LMMS saves *.mmpz* files with Qt's qCompress(), that is:
+    the size of the XML content (32-bit big-endian integer) followed by a zlib stream.
+*/
+bool uncompressMMPZ( const std::string& project_file, std::string& content )
+{
+    const unsigned int HEADER_SIZE = 4;
+    const unsigned long MAX_DEFLATE_RATIO = 1032;   // a deflate stream cannot expand more than this
+
+    std::ifstream infile( project_file, std::ios::binary );
+    if ( !infile )
+    {
+        return false;
+    }
+
+    std::stringstream ss;
+    ss << infile.rdbuf();
+    const std::string& data = ss.str();
+
+    if ( data.size() < HEADER_SIZE )
+    {
+        return false;
+    }
+
+    const unsigned long expected_size = ( static_cast<unsigned long>( static_cast<unsigned char>( data[0] ) ) << 24 ) |
+                                        ( static_cast<unsigned long>( static_cast<unsigned char>( data[1] ) ) << 16 ) |
+                                        ( static_cast<unsigned long>( static_cast<unsigned char>( data[2] ) ) << 8 ) |
+                                          static_cast<unsigned long>( static_cast<unsigned char>( data[3] ) );
+    const unsigned long stream_size = data.size() - HEADER_SIZE;
+
+    if ( expected_size > stream_size * MAX_DEFLATE_RATIO )
+    {
+        return false;
+    }
+
+    std::string xml( expected_size, '\0' );
+    unsigned int xml_size = static_cast<unsigned int>( expected_size );
+    const ZRESULT code = UnzipZlibBuffer( data.data() + HEADER_SIZE, static_cast<unsigned int>( stream_size ), &xml[0], &xml_size );
+
+    if ( code != ZR_OK || xml_size != expected_size )
+    {
+        return false;
+    }
+
+    content = std::move( xml );
+    return true;
+}
+
+}
+
+const std::string decompressProjectContent( const std::string& project_file, const std::string& lmms_command )
+{
+    program::log::Printer print = program::log::getPrinter();
+    std::string content;
+
+    if ( uncompressMMPZ( project_file, content ) )
+    {
+        return content;
+    }
+
+    // Not a format this program knows about, LMMS may know better
+    const std::string& command = lmms_command + " -d " + project_file;
+    print << "-- Cannot decompress the project. Trying with LMMS...\n";
+    print << "-- " << command << "\n";
+    FILE * fpipe = ( FILE * )popen( command.c_str(), "r" );
+    if ( !fpipe )
+    {
+        throw std::system_error( errno, std::system_category(), "Something is wrong with LMMS" );
+    }
+
+    char buffer[4096];
+    std::size_t read_bytes = 0;
+    while ( ( read_bytes = fread( buffer, 1, sizeof( buffer ), fpipe ) ) > 0 )
+    {
+        content.append( buffer, read_bytes );
+    }
+
+    pclose( fpipe );
+    return content;
+}
+
 ghc::filesystem::path decompressProject( const std::string& project_file,
                                          const std::string& package_directory,
                                          const std::string& lmms_command )
@@ -45,8 +138,6 @@ ghc::filesystem::path decompressProject( const std::string& project_file,
     // Assuming the name of the project file has ".mmpz" as an extension
     const std::string& basename = ghc::filesystem::path( project_file ).filename().string();
     const std::string& xml_file = package_directory + basename.substr( 0, basename.size() - 1 );
-    const std::string& command = lmms_command + " -d " + project_file + " > " + xml_file;
-    program::log::Printer print = program::log::getPrinter();
 
     if ( ghc::filesystem::exists( xml_file ) )
     {
@@ -54,37 +145,313 @@ ghc::filesystem::path decompressProject( const std::string& project_file,
                                             "\" already exists. You need to export to a fresh directory.\n" );
     }
 
-    print << "-- " << command << "\n";
-    FILE * fpipe = ( FILE * )popen( command.c_str(), "r" );
-    if ( !fpipe )
+    const std::string& content = decompressProjectContent( project_file, lmms_command );
+    std::ofstream outfile( xml_file, std::ios::binary );
+    outfile.write( content.data(), content.size() );
+    if ( !outfile )
     {
-        throw std::system_error( errno, std::system_category(), "Something is wrong with LMMS" );
+        throw std::system_error( errno, std::system_category(), "Cannot write \"" + xml_file + "\"" );
     }
 
-    pclose( fpipe );
     return ghc::filesystem::path( xml_file );
 }
 
-void compressPackage( const std::string& package_directory, const std::string& package_name );
+void configureZip( HZIP zip, const options::ExportOptions& export_opt );
+void closePackage( HZIP zip, const std::string& package_name );
+HZIP openPreviousPackage( const std::string& package_name, const options::ExportOptions& export_opt );
+const std::vector<ZIPRAWITEM> reusableEntries( HZIP previous, const std::vector<const char *>& entry_names,
+                                               const std::vector<const char *>& file_names, const options::ExportOptions& export_opt );
+ZRESULT addFiles( HZIP zip, HZIP previous, const std::vector<const char *>& entry_names,
+                  const std::vector<const char *>& file_names, const options::ExportOptions& export_opt );
+const std::string deltaDescriptor( std::vector<const char *>& entry_names, std::vector<const char *>& file_names,
+                                   const options::ExportOptions& export_opt );
+void compressPackage( const std::string& package_directory, const std::string& package_name, const options::ExportOptions& export_opt );
+const std::vector<std::vector<int> > splitEntries( const std::vector<long long>& sizes, const unsigned int jobs );
+bool readProjectItem( HZIP zip, const ZIPENTRY& entry, std::unique_ptr<char []>& buffer, const char *& content, std::size_t& size );
+
+void configureZip( HZIP zip, const options::ExportOptions& export_opt )
+{
+    // Compressed audio files (OGG, FLAC, MP3...) are not worth deflating
+    ZipSetStorePolicy( zip, export_opt.store_compressed ? ZIP_STORE_COMPRESSED : ZIP_STORE_ARCHIVES );
+    ZipSetLevel( zip, export_opt.level );
+}
+
+// Write the end of the package, a package that cannot be completed is removed
+void closePackage( HZIP zip, const std::string& package_name )
+{
+    if ( CloseZip( zip ) != ZR_OK )
+    {
+        std::error_code ec;
+        ghc::filesystem::remove( package_name, ec );
+        throw PackageExportException( "ERROR: Cannot write \"" + ghc::filesystem::normalize( package_name ) + "\". Packaging aborted.\n" );
+    }
+}
+
+/*
+    Open the package given to --update, if any, before "package_name" is created.
+*/
+HZIP openPreviousPackage( const std::string& package_name, const options::ExportOptions& export_opt )
+{
+    if ( export_opt.update_package.empty() )
+    {
+        return nullptr;
+    }
+
+    std::error_code ec;
+    if ( ghc::filesystem::equivalent( export_opt.update_package, package_name, ec ) )
+    {
+        throw PackageExportException( "ERROR: \"" + export_opt.update_package + "\" cannot be updated in place.\n" );
+    }
+
+    HZIP previous = OpenZipMapped( export_opt.update_package.c_str(), nullptr );
+    if ( previous == nullptr )
+    {
+        throw PackageExportException( "ERROR: Cannot read the package to update \"" + export_opt.update_package + "\".\n" );
+    }
+    return previous;
+}
+
+// The root directory of the package is named after the package file, which may have been renamed since
+const std::string packagePath( const std::string& entry )
+{
+    std::string path( entry );
+    std::replace( path.begin(), path.end(), '\\', '/' );
+    const std::size_t slash = path.find( '/' );
+    return slash == std::string::npos ? path : path.substr( slash + 1 );
+}
+
+bool entryHash( HZIP zip, const int index, content::Hash& hash )
+{
+    ZIPRAWITEM raw;
+    if ( GetZipItemRaw( zip, index, &raw ) != ZR_OK )
+    {
+        return false;
+    }
+
+    const void * view = nullptr;
+    long long view_size = 0;
+    if ( GetZipItemView( zip, index, &view, &view_size ) == ZR_OK )
+    {
+        const unsigned char * data = static_cast<const unsigned char *>( view );
+        hash = content::dataHash( data, static_cast<std::size_t>( view_size ) );
+        return zcrc32( 0, data, static_cast<std::size_t>( view_size ) ) == raw.crc;
+    }
+
+    const unsigned int BLOCK_SIZE = 65536;
+    std::unique_ptr<unsigned char []> buffer( new unsigned char[BLOCK_SIZE] );
+    content::Hasher hasher;
+    unsigned long crc = 0;
+    long long remaining = raw.unc_size;
+    ZRESULT code = ZR_MORE;
+
+    while ( code == ZR_MORE )
+    {
+        // The whole buffer is filled while there is more to come, the rest of the entry otherwise
+        code = UnzipItem( zip, index, buffer.get(), BLOCK_SIZE );
+        const long long n = ( code == ZR_MORE ) ? BLOCK_SIZE : remaining;
+        if ( ( code != ZR_OK && code != ZR_MORE ) || n < 0 || n > BLOCK_SIZE )
+        {
+            return false;
+        }
+        hasher.update( buffer.get(), static_cast<std::size_t>( n ) );
+        crc = zcrc32( crc, buffer.get(), static_cast<std::size_t>( n ) );
+        remaining -= n;
+    }
+    hash = hasher.hash();
+    return crc == raw.crc;
+}
+
+/*
+    Find the files that did not change since the previous package was made. The entry of such a file
+    has the same path in the previous package, the same size and the same modification time, which reject
+    most of the changed files without reading them, and then the same content hash. As the data of the entry
+    is copied as it is, it must also match its CRC-32.
+    Its raw item is returned, "data" is null for any other file.
+*/
+const std::vector<ZIPRAWITEM> reusableEntries( HZIP previous, const std::vector<const char *>& entry_names,
+                                               const std::vector<const char *>& file_names, const options::ExportOptions& export_opt )
+{
+    ZIPENTRY ze;
+    GetZipItem( previous, -1, &ze );
+    const int numitems = ze.index;
+
+    std::map<std::string, ZIPENTRY> previous_entries;
+    for ( int index = 0; index < numitems; index++ )
+    {
+        ZIPENTRY entry;
+        GetZipItem( previous, index, &entry );
+        const std::string& name = entry.name;
+        if ( !name.empty() && name.back() != '/' )
+        {
+            previous_entries[packagePath( name )] = entry;
+        }
+    }
+
+    std::vector<ZIPRAWITEM> raws( entry_names.size(), ZIPRAWITEM() );
+    std::vector<int> indices( entry_names.size(), -1 );
+    std::vector<std::size_t> candidates;
+    for ( std::size_t i = 0; i < entry_names.size(); i++ )
+    {
+        const auto& found = previous_entries.find( packagePath( entry_names[i] ) );
+        std::error_code ec;
+        if ( file_names[i] == nullptr || found == previous_entries.cend() ||
+             GetZipItemRaw( previous, found->second.index, &raws[i] ) != ZR_OK ||
+             static_cast<long long>( ghc::filesystem::file_size( file_names[i], ec ) ) != raws[i].unc_size || ec )
+        {
+            raws[i].data = nullptr;
+            continue;
+        }
+
+        const auto& mtime = ghc::filesystem::last_write_time( file_names[i], ec );
+        if ( ec || std::chrono::duration_cast<std::chrono::seconds>( mtime.time_since_epoch() ).count() != found->second.mtime )
+        {
+            raws[i].data = nullptr;
+            continue;
+        }
+        indices[i] = found->second.index;
+        candidates.push_back( i );
+    }
+
+    std::vector<content::Hash> file_hashes( candidates.size() );
+    workers::runParallel( candidates.size(), export_opt.jobs, [&] ( const std::size_t c )
+    {
+        file_hashes[c] = content::fileHash( file_names[candidates[c]] );
+    } );
+
+    // A reader cannot be shared between threads, so every worker opens the previous package
+    // and checks its own share of the entries
+    const std::size_t readers = std::min<std::size_t>( std::max( 1U, export_opt.jobs ), candidates.size() );
+    workers::runParallel( readers, export_opt.jobs, [&] ( const std::size_t w )
+    {
+        HZIP reader = OpenZipMapped( export_opt.update_package.c_str(), nullptr );
+        for ( std::size_t c = w; c < candidates.size(); c += readers )
+        {
+            const std::size_t i = candidates[c];
+            content::Hash hash;
+            if ( reader == nullptr || !entryHash( reader, indices[i], hash ) ||
+                 hash.low != file_hashes[c].low || hash.high != file_hashes[c].high )
+            {
+                raws[i].data = nullptr;
+            }
+        }
+
+        if ( reader != nullptr )
+        {
+            CloseZip( reader );
+        }
+    } );
+    return raws;
+}
 
-void compressPackage( const std::string& package_directory, const std::string& package_name )
+/*
+    Add the files to the package, in order. If there is a previous package, the unchanged files are
+    copied from it as they are, and only the other ones are compressed.
+*/
+ZRESULT addFiles( HZIP zip, HZIP previous, const std::vector<const char *>& entry_names,
+                  const std::vector<const char *>& file_names, const options::ExportOptions& export_opt )
+{
+    const unsigned int jobs = export_opt.jobs;
+    const int count = static_cast<int>( entry_names.size() );
+    if ( previous == nullptr )
+    {
+        return ZipAddFiles( zip, count, entry_names.data(), file_names.data(), jobs );
+    }
+
+    program::log::Printer print = program::log::getPrinter();
+    const std::vector<ZIPRAWITEM>& raws = reusableEntries( previous, entry_names, file_names, export_opt );
+    ZRESULT code = ZR_OK;
+    int first = 0;      // First entry of the files to compress
+
+    for ( int i = 0; i <= count && code == ZR_OK; i++ )
+    {
+        if ( i < count && raws[i].data == nullptr )
+        {
+            continue;
+        }
+
+        if ( i > first )
+        {
+            code = ZipAddFiles( zip, i - first, entry_names.data() + first, file_names.data() + first, jobs );
+        }
+
+        if ( i < count && code == ZR_OK )
+        {
+            print << "zip: reuse " << entry_names[i] << "\n";
+            code = ZipAddRaw( zip, entry_names[i], file_names[i], raws[i].data, raws[i].comp_size, raws[i].crc, raws[i].method );
+        }
+        first = i + 1;
+    }
+    return code;
+}
+
+/*
+    With --delta, remove the resources that the base package already has from the files to add,
+    and give the content of the descriptor of the delta package. Give an empty string without --delta.
+*/
+const std::string deltaDescriptor( std::vector<const char *>& entry_names, std::vector<const char *>& file_names,
+                                   const options::ExportOptions& export_opt )
+{
+    if ( export_opt.delta_base.empty() )
+    {
+        return "";
+    }
+
+    const std::string RESOURCES( "resources/" );
+    std::vector<std::size_t> resources;
+    std::vector<std::string> paths;
+    std::vector<std::string> files;
+    for ( std::size_t i = 0; i < entry_names.size(); i++ )
+    {
+        const std::string& path = packagePath( entry_names[i] );
+        if ( file_names[i] != nullptr && path.compare( 0, RESOURCES.size(), RESOURCES ) == 0 )
+        {
+            resources.push_back( i );
+            paths.push_back( path );
+            files.push_back( file_names[i] );
+        }
+    }
+
+    const delta::Descriptor& descriptor = delta::compareWithBase( export_opt.delta_base, paths, files, export_opt.jobs );
+    std::vector<bool> in_base( entry_names.size(), false );
+    for ( std::size_t i = 0; i < resources.size(); i++ )
+    {
+        in_base[resources[i]] = !descriptor.resources[i].in_package;
+    }
+
+    std::size_t kept = 0;
+    for ( std::size_t i = 0; i < entry_names.size(); i++ )
+    {
+        if ( !in_base[i] )
+        {
+            entry_names[kept] = entry_names[i];
+            file_names[kept] = file_names[i];
+            kept++;
+        }
+    }
+    entry_names.resize( kept );
+    file_names.resize( kept );
+    return delta::descriptorContent( descriptor );
+}
+
+void compressPackage( const std::string& package_directory, const std::string& package_name, const options::ExportOptions& export_opt )
 {
     const ghc::filesystem::path dir_parent = ghc::filesystem::absolute( package_directory ).parent_path().parent_path();
-    HZIP zip = CreateZip( package_name.c_str(), nullptr );
     program::log::Printer print = program::log::getPrinter();
 
+    // Entries are gathered first, so that the files can be compressed in parallel
+    std::vector<std::string> entries;
+    std::vector<std::string> paths;
+    std::vector<bool> folders;
     for ( const auto& file : ghc::filesystem::recursive_directory_iterator( package_directory ) )
     {
         const std::string& filename = ghc::filesystem::relative( ghc::filesystem::absolute( file.path() ), dir_parent ).string();
         print << "zip: " << ghc::filesystem::normalize( filename ) << "\n";
 
-        if ( ghc::filesystem::is_regular_file( file.path() ) )
-        {
-            ZipAdd( zip, filename.c_str(), file.path().string().c_str() );
-        }
-        else if ( ghc::filesystem::is_directory( file.path() ) )
+        if ( ghc::filesystem::is_regular_file( file.path() ) || ghc::filesystem::is_directory( file.path() ) )
         {
-            ZipAddFolder( zip, filename.c_str() );
+            entries.push_back( filename );
+            paths.push_back( file.path().string() );
+            folders.push_back( ghc::filesystem::is_directory( file.path() ) );
         }
         else
         {
@@ -92,40 +459,235 @@ void compressPackage( const std::string& package_directory, const std::string& p
         }
     }
 
-    CloseZip( zip );
+    std::vector<const char *> entry_names;
+    std::vector<const char *> file_names;
+    for ( std::size_t i = 0; i < entries.size(); i++ )
+    {
+        entry_names.push_back( entries[i].c_str() );
+        file_names.push_back( folders[i] ? nullptr : paths[i].c_str() );
+    }
+    const std::string& descriptor = deltaDescriptor( entry_names, file_names, export_opt );
+
+    HZIP previous = openPreviousPackage( package_name, export_opt );
+    HZIP zip = CreateZip( package_name.c_str(), nullptr );
+    if ( zip == nullptr )
+    {
+        if ( previous != nullptr )
+        {
+            CloseZip( previous );
+        }
+        throw PackageExportException( "ERROR: Cannot create \"" + ghc::filesystem::normalize( package_name ) + "\".\n" );
+    }
+    configureZip( zip, export_opt );
+
+    const auto& abort_export = [&] ( const std::string& entry )
+    {
+        CloseZip( zip );
+        if ( previous != nullptr )
+        {
+            CloseZip( previous );
+        }
+        std::error_code ec;
+        ghc::filesystem::remove( package_name, ec );
+        throw PackageExportException( "ERROR: Cannot add \"" + entry + "\" into the package. Packaging aborted.\n" );
+    };
+
+    const std::string& root_name = ghc::filesystem::path( package_name ).stem().string() + "/";
+    if ( addFiles( zip, previous, entry_names, file_names, export_opt ) != ZR_OK )
+    {
+        abort_export( root_name );
+    }
+
+    if ( !descriptor.empty() )
+    {
+        const std::string& descriptor_entry = root_name + delta::DESCRIPTOR_ENTRY;
+        print << "zip: " << descriptor_entry << "\n";
+        if ( ZipAdd( zip, descriptor_entry.c_str(), const_cast<char *>( descriptor.data() ), descriptor.size() ) != ZR_OK )
+        {
+            abort_export( descriptor_entry );
+        }
+    }
+
+    if ( previous != nullptr )
+    {
+        CloseZip( previous );
+    }
+    closePackage( zip, package_name );
 }
 
+/*
+    Split the entries of a package into at most "jobs" sets of similar sizes, so that they can be extracted in parallel.
+    The biggest entries are dealt first, each one to the lightest set. Every set keeps its entries in the package order.
+*/
+const std::vector<std::vector<int> > splitEntries( const std::vector<long long>& sizes, const unsigned int jobs )
+{
+    const std::size_t nsets = std::max<std::size_t>( 1, std::min<std::size_t>( jobs, sizes.size() ) );
+    std::vector<int> order( sizes.size() );
+    std::iota( order.begin(), order.end(), 0 );
+    std::stable_sort( order.begin(), order.end(), [&sizes] ( const int a, const int b )
+    {
+        return sizes[a] > sizes[b];
+    } );
 
-bool checkLMMSProjectFile( const ghc::filesystem::path& lmms_file )
+    std::vector<std::vector<int> > sets( nsets );
+    std::vector<long long> loads( nsets, 0 );
+    for ( const int index : order )
+    {
+        const std::size_t lightest = std::min_element( loads.cbegin(), loads.cend() ) - loads.cbegin();
+        sets[lightest].push_back( index );
+        loads[lightest] += sizes[index];
+    }
+
+    for ( std::vector<int>& set : sets )
+    {
+        std::sort( set.begin(), set.end() );
+    }
+    return sets;
+}
+
+/*
+    Give the content of the project file "entry" of the package: a view into the mapped package if the file
+    is stored, or else the file unzipped into "buffer", which is sized after it.
+*/
+bool readProjectItem( HZIP zip, const ZIPENTRY& entry, std::unique_ptr<char []>& buffer, const char *& content, std::size_t& size )
 {
-    std::ifstream infile( lmms_file.string() );
-    if ( infile )
+    const void * view = nullptr;
+    long long view_size = 0;
+    if ( GetZipItemView( zip, entry.index, &view, &view_size ) == ZR_OK )
     {
-        std::stringstream ss;
-        ss << infile.rdbuf();
-        infile.close();
+        content = static_cast<const char *>( view );
+        size = static_cast<std::size_t>( view_size );
+        return true;
+    }
 
-        const unsigned int BUFSIZE = 4194304; // 4 Mio, that should be enough to cover most project files
-        const std::unique_ptr<char []> buffer = std::make_unique<char []>( BUFSIZE );
-        ss.read( buffer.get(), BUFSIZE );
-        return xml::checkLMMSProjectBuffer( buffer, BUFSIZE );
+    // UnzipItem fills at most 4 Gio in memory, a project file is far from it
+    if ( entry.unc_size < 0 || entry.unc_size > 0xFFFFFFFFLL )
+    {
+        return false;
     }
-    return false;
+
+    size = static_cast<std::size_t>( entry.unc_size );
+    buffer.reset( new char[size + 1] );
+    content = buffer.get();
+    return size == 0 || UnzipItem ( zip, entry.index, buffer.get(), static_cast<unsigned int>( size ) ) == ZR_OK;
 }
 
 
-const ghc::filesystem::path zipFile( const ghc::filesystem::path& package_directory )
+
+const ghc::filesystem::path packageFile( const ghc::filesystem::path& package_directory )
+{
+    const std::string& pkg_dir_txt = package_directory.string();
+    return ghc::filesystem::path( ( pkg_dir_txt.back() == '/' || pkg_dir_txt.back() == '\\' ) ?
+                                  pkg_dir_txt.substr( 0, pkg_dir_txt.size() - 1 ) + PACKAGE_EXTENSION :
+                                  pkg_dir_txt + PACKAGE_EXTENSION );
+}
+
+const ghc::filesystem::path zipFile( const ghc::filesystem::path& package_directory, const options::ExportOptions& export_opt )
 {
     const std::string& pkg_dir_txt = package_directory.string();
-    const std::string& package_name = ( pkg_dir_txt.back() == '/' || pkg_dir_txt.back() == '\\' ) ?
-                                        pkg_dir_txt.substr( 0, pkg_dir_txt.size() - 1 ) + PACKAGE_EXTENSION :
-                                        pkg_dir_txt + PACKAGE_EXTENSION;
+    const std::string& package_name = packageFile( package_directory ).string();
 
-    compressPackage( pkg_dir_txt, package_name );
+    compressPackage( pkg_dir_txt, package_name, export_opt );
     return ghc::filesystem::path( package_name );
 }
 
-const ghc::filesystem::path unzipFile( const ghc::filesystem::path& package, const ghc::filesystem::path& directory )
+const ghc::filesystem::path zipExportedProject( const ghc::filesystem::path& package_directory,
+                                                const std::string& project_filename, const std::string& project_content,
+                                                const std::vector<ExportedFile>& exported_files,
+                                                const options::ExportOptions& export_opt )
+{
+    const std::string& package_name = packageFile( package_directory ).string();
+    const std::string& root_name = ghc::filesystem::path( package_name ).stem().string() + "/";
+    const std::string& resources_name = root_name + "resources/";
+    program::log::Printer print = program::log::getPrinter();
+
+    print << "zip: " << resources_name << "\n";
+    std::vector<std::string> entries;
+    std::vector<std::string> locations;
+    for ( const ExportedFile& file : exported_files )
+    {
+        // A file with the same content as a previous one is already stored under the same entry
+        if ( file.duplicate )
+        {
+            continue;
+        }
+        entries.push_back( resources_name + file.dest.string() );
+        locations.push_back( file.location.string() );
+        print << "zip: " << ghc::filesystem::normalize( locations.back() ) << " -> " << entries.back() << "\n";
+    }
+
+    std::vector<const char *> entry_names;
+    std::vector<const char *> file_names;
+    for ( std::size_t i = 0; i < entries.size(); i++ )
+    {
+        entry_names.push_back( entries[i].c_str() );
+        file_names.push_back( locations[i].c_str() );
+    }
+    const std::string& descriptor = deltaDescriptor( entry_names, file_names, export_opt );
+
+    HZIP previous = openPreviousPackage( package_name, export_opt );
+    HZIP zip = CreateZip( package_name.c_str(), nullptr );
+    if ( zip == nullptr )
+    {
+        if ( previous != nullptr )
+        {
+            CloseZip( previous );
+        }
+        throw PackageExportException( "ERROR: Cannot create \"" + ghc::filesystem::normalize( package_name ) + "\".\n" );
+    }
+    configureZip( zip, export_opt );
+
+    const auto& abort_export = [&] ( const std::string& entry )
+    {
+        CloseZip( zip );
+        if ( previous != nullptr )
+        {
+            CloseZip( previous );
+        }
+        std::error_code ec;
+        ghc::filesystem::remove( package_name, ec );
+        throw PackageExportException( "ERROR: Cannot add \"" + entry + "\" into the package. Packaging aborted.\n" );
+    };
+
+    if ( ZipAddFolder( zip, resources_name.c_str() ) != ZR_OK )
+    {
+        abort_export( resources_name );
+    }
+
+    if ( addFiles( zip, previous, entry_names, file_names, export_opt ) != ZR_OK )
+    {
+        abort_export( resources_name );
+    }
+
+    if ( previous != nullptr )
+    {
+        CloseZip( previous );
+        previous = nullptr;
+    }
+
+    const std::string& project_entry = root_name + project_filename;
+    print << "zip: " << project_entry << "\n";
+    if ( ZipAdd( zip, project_entry.c_str(), const_cast<char *>( project_content.data() ), project_content.size() ) != ZR_OK )
+    {
+        abort_export( project_entry );
+    }
+
+    const std::string& descriptor_entry = root_name + delta::DESCRIPTOR_ENTRY;
+    if ( !descriptor.empty() )
+    {
+        print << "zip: " << descriptor_entry << "\n";
+        if ( ZipAdd( zip, descriptor_entry.c_str(), const_cast<char *>( descriptor.data() ), descriptor.size() ) != ZR_OK )
+        {
+            abort_export( descriptor_entry );
+        }
+    }
+
+    closePackage( zip, package_name );
+    return ghc::filesystem::path( package_name );
+}
+
+const ghc::filesystem::path unzipFile( const ghc::filesystem::path& package, const ghc::filesystem::path& directory,
+                                       const unsigned int jobs )
 {
     program::log::Printer print = program::log::getPrinter();
     HZIP zip = OpenZip( package.string().c_str(), nullptr );
@@ -134,45 +696,73 @@ const ghc::filesystem::path unzipFile( const ghc::filesystem::path& package, con
 
     const int numitems = ze.index;
     ghc::filesystem::path project_path( directory );
+    std::vector<int> indices;
+    std::vector<std::string> names;
 
+    // The entries are extracted straight into the destination directory,
+    // but an already extracted package must not be overwritten.
     for ( int index = 0; index < numitems; index++ )
     {
         ZIPENTRY entry;
         GetZipItem( zip, index, &entry );
         const std::string& filename = entry.name;
+        const ghc::filesystem::path target( directory / ghc::filesystem::path( filename ) );
 
-        print << "-- Extract \"" << filename << "\".\n";
-        const int code = UnzipItem ( zip, index, filename.c_str() );
-        if ( code != ZR_OK )
+        if ( filename.back() != '/' && ghc::filesystem::exists( target ) )
         {
             CloseZip( zip );
-            throw PackageImportException( "ERROR: Cannot unzip " + filename + ".\n" );
+            throw AlreadyExistingFileException( "ERROR: \"" + ghc::filesystem::normalize( target.string() )
+                                                + "\" already exists. You need to unpack into another directory.\n" );
         }
 
         if ( ghc::filesystem::hasExtension( ghc::filesystem::path( filename ), ".mmp" ) )
         {
             project_path /= ghc::filesystem::path( filename );
         }
+
+        print << "-- Extract \"" << filename << "\".\n";
+        indices.push_back( index );
+        names.push_back( filename );
     }
 
     CloseZip( zip );
+    unzipEntries( package, directory, indices, names, jobs );
+    return project_path;
+}
 
-    try
+void unzipEntries( const ghc::filesystem::path& package, const ghc::filesystem::path& directory,
+                   const std::vector<int>& indices, const std::vector<std::string>& names, const unsigned int jobs )
+{
+    HZIP zip = OpenZipMapped( package.string().c_str(), nullptr );
+    std::vector<long long> sizes;
+    for ( const int index : indices )
     {
-        std::error_code ec;
-        auto option = ghc::filesystem::copy_options::recursive;
-        const ghc::filesystem::path target_path( directory.string() + "/" + package.stem().string() );
-        ghc::filesystem::copy( package.stem(), target_path, option );
-        ghc::filesystem::remove_all( package.stem(), ec );
+        ZIPENTRY entry;
+        GetZipItem( zip, index, &entry );
+        sizes.push_back( entry.comp_size );
     }
-    catch ( ghc::filesystem::filesystem_error& e )
+    CloseZip( zip );
+
+    // A reader cannot be shared between threads, so every worker opens the package
+    // and extracts its own set of entries
+    const std::vector<std::vector<int> >& sets = splitEntries( sizes, jobs );
+    workers::runParallel( sets.size(), jobs, [&] ( const std::size_t i )
     {
-        std::error_code ec;
-        ghc::filesystem::remove_all( package.stem(), ec );
-        throw PackageImportException( "ERROR: " + std::string( e.what() ) );
-    }
+        HZIP reader = OpenZipMapped( package.string().c_str(), nullptr );
+        SetUnzipBaseDir( reader, directory.string().c_str() );
 
-    return project_path;
+        for ( const int k : sets[i] )
+        {
+            const int code = UnzipItem ( reader, indices[k], names[k].c_str() );
+            if ( code != ZR_OK )
+            {
+                CloseZip( reader );
+                throw PackageImportException( "ERROR: Cannot unzip " + names[k] + ".\n" );
+            }
+        }
+
+        CloseZip( reader );
+    } );
 }
 
 bool checkZipFile( const ghc::filesystem::path& package_file )
@@ -183,7 +773,7 @@ bool checkZipFile( const ghc::filesystem::path& package_file )
 
     if ( ghc::filesystem::exists( package_file ) )
     {
-        HZIP zip = OpenZip( package_file.string().c_str(), nullptr );
+        HZIP zip = OpenZipMapped( package_file.string().c_str(), nullptr );
 
         ZIPENTRY ze;
         GetZipItem( zip, -1, &ze );
@@ -206,14 +796,14 @@ bool checkZipFile( const ghc::filesystem::path& package_file )
 
             if ( ghc::filesystem::hasExtension( ghc::filesystem::path( filename ), ".mmp" ) )
             {
-                const unsigned int BUFSIZE = 4194304; // 4 Mio, that should be enough to cover most project files
-                const std::unique_ptr<char []> buffer = std::make_unique<char []>( BUFSIZE );
+                std::unique_ptr<char []> buffer;
+                const char * content = nullptr;
+                std::size_t size = 0;
 
-                int code = UnzipItem ( zip, index, buffer.get(), BUFSIZE );
-                if ( code == ZR_OK )
+                if ( readProjectItem( zip, entry, buffer, content, size ) )
                 {
                     print << "-- Checking project file...\n";
-                    if ( xml::checkLMMSProjectBuffer( buffer, BUFSIZE ) )
+                    if ( xml::checkLMMSProjectBuffer( content, size ) )
                     {
                         valid_project_file = true;
                         print << "-- Project file OK\n";
@@ -268,7 +858,7 @@ bool zipFileInfo( const ghc::filesystem::path& package_file )
             return false;
         }
 
-        HZIP zip = OpenZip( package_file.string().c_str(), nullptr );
+        HZIP zip = OpenZipMapped( package_file.string().c_str(), nullptr );
 
         ZIPENTRY ze;
         GetZipItem( zip, -1, &ze );
@@ -281,27 +871,34 @@ bool zipFileInfo( const ghc::filesystem::path& package_file )
         }
 
         std::vector<std::string> filenames;
+        std::vector<long long> sizes;
+        long long total_size = 0;
+        long long total_compressed_size = 0;
         for ( int index = 0; index < numitems; index++ )
         {
             ZIPENTRY entry;
             GetZipItem( zip, index, &entry );
             const std::string filename( entry.name );
+            // Sizes are 64-bit: items over 4 Gio are stored as Zip64 entries
+            total_size += entry.unc_size;
+            total_compressed_size += entry.comp_size;
 
             if ( ghc::filesystem::hasExtension( ghc::filesystem::path( filename ), ".mmp" ) )
             {
-                const unsigned int BUFSIZE = 4194304; // 4 Mio, that should be enough to cover most project files
-                const std::unique_ptr<char []> buffer = std::make_unique<char []>( BUFSIZE );
+                std::unique_ptr<char []> buffer;
+                const char * content = nullptr;
+                std::size_t size = 0;
 
-                int code = UnzipItem ( zip, index, buffer.get(), BUFSIZE );
-                if ( code == ZR_OK )
+                if ( readProjectItem( zip, entry, buffer, content, size ) )
                 {
                     std::cout << "-- Project: " << ghc::filesystem::path( filename ).filename().string() << "\n";
-                    if ( !xml::projectInfo( buffer, BUFSIZE ) )
+                    if ( !xml::projectInfo( content, size ) )
                     {
                         CloseZip( zip );
                         return false;
                     }
                     filenames.push_back( filename );
+                    sizes.push_back( entry.unc_size );
                 }
                 else
                 {
@@ -313,20 +910,27 @@ bool zipFileInfo( const ghc::filesystem::path& package_file )
             else
             {
                 filenames.push_back( filename );
+                sizes.push_back( entry.unc_size );
             }
         }
 
         print << "\n-- Files: \n";
-        for (const std::string& filename : filenames)
+        for ( std::size_t i = 0; i < filenames.size(); i++ )
         {
-            print << "---- " << filename << "\n";
+            print << "---- " << filenames[i];
+            if ( filenames[i].back() != '/' )
+            {
+                print << " (" << sizes[i] << " bytes)";
+            }
+            print << "\n";
         }
 
         // The package must have at least two files: the project file and the resources/ directory
         print << "-- Total:\n"
               << "---- " << numitems << " items in the zip file.\n"
               << "---- " << ( numitems >= 2 ? filenames.size() - 2 : filenames.size() )
-              << " audio file(s).\n";
+              << " audio file(s).\n"
+              << "---- " << total_size << " bytes of data, " << total_compressed_size << " bytes compressed.\n";
         CloseZip( zip );
         return true;
     }
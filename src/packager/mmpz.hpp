@@ -20,6 +20,21 @@
 #define MMPZ_HPP_INCLUDED
 
 #include <string>
+#include <vector>
+
+struct ExportedFile;
+struct HZIP__;
+typedef HZIP__ * HZIP;
+
+namespace content
+{
+struct Hash;
+}
+
+namespace options
+{
+struct ExportOptions;
+}
 
 namespace ghc
 {
@@ -32,15 +47,53 @@ class path;
 namespace lmms
 {
 
+/*
+    Decompress a *.mmpz* project file into the destination directory.
+    The project is decoded by the program itself. LMMS (lmms_command) is only used
+    if the file cannot be decoded that way.
+*/
 ghc::filesystem::path decompressProject( const std::string& project_file,
                                          const std::string& destination_directory,
                                          const std::string& lmms_command = "lmms" );
 
-const ghc::filesystem::path zipFile( const ghc::filesystem::path& package_directory );
-const ghc::filesystem::path unzipFile( const ghc::filesystem::path& package, const ghc::filesystem::path& directory );
+// Same as decompressProject, but the XML content is returned instead of being written into a file
+const std::string decompressProjectContent( const std::string& project_file, const std::string& lmms_command = "lmms" );
+
+// "package/resources/file" -> "resources/file": the path of an entry in the root directory of its package
+const std::string packagePath( const std::string& entry );
+
+/*
+    Hash the content of the entry "index" of an opened package in constant memory (in place if the entry
+    is stored, or else unzipped block by block).
+    Return false if the entry cannot be read, or if its content does not match the CRC-32 of the entry.
+*/
+bool entryHash( HZIP zip, const int index, content::Hash& hash );
+
+// "path/to/package/" -> "path/to/package.mmpk"
+const ghc::filesystem::path packageFile( const ghc::filesystem::path& package_directory );
+const ghc::filesystem::path zipFile( const ghc::filesystem::path& package_directory, const options::ExportOptions& export_opt );
+/*
+    Create the package directly from the resource files and the configured project content,
+    without the intermediate package directory. The entries are the same as the ones
+    zipFile() generates: "<name>/<project>", "<name>/resources/" and "<name>/resources/<file>".
+*/
+const ghc::filesystem::path zipExportedProject( const ghc::filesystem::path& package_directory,
+                                                const std::string& project_filename, const std::string& project_content,
+                                                const std::vector<ExportedFile>& exported_files,
+                                                const options::ExportOptions& export_opt );
+/*
+    Extract the package into "directory" using at most "jobs" threads, and return the path of the extracted project file.
+*/
+const ghc::filesystem::path unzipFile( const ghc::filesystem::path& package, const ghc::filesystem::path& directory,
+                                       const unsigned int jobs );
+/*
+    Extract the entries "indices" of the package into "directory" using at most "jobs" threads,
+    the entry indices[i] being written as names[i], a path relative to "directory".
+*/
+void unzipEntries( const ghc::filesystem::path& package, const ghc::filesystem::path& directory,
+                   const std::vector<int>& indices, const std::vector<std::string>& names, const unsigned int jobs );
 bool checkZipFile( const ghc::filesystem::path& package_file );
 bool zipFileInfo( const ghc::filesystem::path& package_file );
-bool checkLMMSProjectFile( const ghc::filesystem::path& lmms_file );
 }
 
 #endif // MMPZ_HPP_INCLUDED
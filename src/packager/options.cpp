@@ -17,11 +17,14 @@
 */
 
 #include "options.hpp"
+#include "workers.hpp"
 #include "../external/filesystem/filesystem.hpp"
 #include "../external/argparse/argparse.hpp"
 
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
 
 
 namespace fs = ghc::filesystem;
@@ -33,6 +36,9 @@ std::string addTrailingSlashIfNeeded( const std::string& path ) noexcept;
 const argparse::ArgumentParser parse( const std::vector<std::string> argv );
 OperationType getOperationType( const argparse::ArgumentParser& parser );
 const ExportOptions retrieveExportInfo( const argparse::ArgumentParser& parser );
+unsigned int retrieveJobCount( const argparse::ArgumentParser& parser );
+int retrieveCompressionLevel( const argparse::ArgumentParser& parser );
+const std::string retrieveResourceIndexFile( const argparse::ArgumentParser& parser );
 
 std::string addTrailingSlashIfNeeded( const std::string& path ) noexcept
 {
@@ -50,11 +56,22 @@ const argparse::ArgumentParser parse( const std::vector<std::string> argv )
            .addArgument( "-p", "--pack" )
            .addArgument( "-c", "--check" )
            .addArgument( "-i", "--info" )
+           .addArgument( "-b", "--batch" )
            .addArgument( "-v", "--verbose" )
            .addArgument( "--no-zip" )
+           .addArgument( "--stream" )
+           .addArgument( "--deflate-all" )
+           .addArgument( "--level", 1 )
+           .addArgument( "--fast" )
+           .addArgument( "--best" )
            .addArgument( "--sf2" )
            .addArgument( "--lmms-exe", 1 )
            .addArgument( "--rsc-dirs", '+' )
+           .addArgument( "--rsc-index", 1 )
+           .addArgument( "--update", 1 )
+           .addArgument( "--delta", 1 )
+           .addArgument( "--base", '+' )
+           .addArgument( "-j", "--jobs", 1 )
            .addArgument( "-t", "--target", 1 )
            .addFinalArgument( "source", 1 ).useExceptions( true ).parse( argv );
 }
@@ -67,7 +84,7 @@ OperationType getOperationType( const argparse::ArgumentParser& parser )
     unsigned int op_count = 0;
     for ( const auto& arg: parsed_args )
     {
-        if ( arg.name == "check" || arg.name == "info" || arg.name == "pack" || arg.name == "unpack" )
+        if ( arg.name == "check" || arg.name == "info" || arg.name == "pack" || arg.name == "unpack" || arg.name == "batch" )
         {
             op_count++;
         }
@@ -75,11 +92,11 @@ OperationType getOperationType( const argparse::ArgumentParser& parser )
 
     if ( op_count > 1 )
     {
-        throw std::invalid_argument("Too many operation types provided. You must provide only one of { pack, unpack, check, info }.\n");
+        throw std::invalid_argument("Too many operation types provided. You must provide only one of { pack, unpack, check, info, batch }.\n");
     }
     else if ( op_count == 0 )
     {
-        throw std::invalid_argument("Missing operation type. You must provide one of { pack, unpack, check, info }.\n");
+        throw std::invalid_argument("Missing operation type. You must provide one of { pack, unpack, check, info, batch }.\n");
     }
 
     if ( parser.retrieve<bool> ( "check" ) )
@@ -102,19 +119,109 @@ OperationType getOperationType( const argparse::ArgumentParser& parser )
         return OperationType::Unpack;
     }
 
+    if ( parser.retrieve<bool> ( "batch" ) )
+    {
+        return OperationType::Batch;
+    }
+
 
     throw std::invalid_argument( "Internal error. Please contact a developer." );
 }
 
 
+unsigned int retrieveJobCount( const argparse::ArgumentParser& parser )
+{
+    if ( !parser.hasParsedArgument( "jobs" ) )
+    {
+        return workers::defaultJobCount();
+    }
+
+    const std::string& jobs = parser.retrieve( "jobs" );
+    if ( jobs.empty() || !std::all_of( jobs.cbegin(), jobs.cend(), [] ( const char c ) { return c >= '0' && c <= '9'; } )
+         || jobs.size() > 4 || std::stoi( jobs ) == 0 )
+    {
+        throw std::invalid_argument( "Invalid number of jobs: \"" + jobs + "\". It must be a positive integer.\n" );
+    }
+    return static_cast<unsigned int>( std::stoi( jobs ) );
+}
+
+
+int retrieveCompressionLevel( const argparse::ArgumentParser& parser )
+{
+    const int DEFAULT_LEVEL = 8;
+    const int FAST_LEVEL = 1;
+    const int BEST_LEVEL = 9;
+
+    const bool has_level = parser.hasParsedArgument( "level" );
+    const bool fast = parser.retrieve<bool>( "fast" );
+    const bool best = parser.retrieve<bool>( "best" );
+
+    if ( ( has_level ? 1 : 0 ) + ( fast ? 1 : 0 ) + ( best ? 1 : 0 ) > 1 )
+    {
+        throw std::invalid_argument( "Only one of { --level, --fast, --best } can be provided.\n" );
+    }
+
+    if ( fast )
+    {
+        return FAST_LEVEL;
+    }
+
+    if ( best )
+    {
+        return BEST_LEVEL;
+    }
+
+    if ( has_level )
+    {
+        const std::string& level = parser.retrieve( "level" );
+        if ( level.size() != 1 || level[0] < '0' || level[0] > '9' )
+        {
+            throw std::invalid_argument( "Invalid compression level: \"" + level + "\". It must be between 0 and 9.\n" );
+        }
+        return level[0] - '0';
+    }
+
+    return DEFAULT_LEVEL;
+}
+
+
+const std::string retrieveResourceIndexFile( const argparse::ArgumentParser& parser )
+{
+    if ( parser.hasParsedArgument( "rsc-index" ) )
+    {
+        return parser.retrieve( "rsc-index" );
+    }
+
+    // Default: in the cache directory of the user, if there is one
+    const char * cache_home = std::getenv( "XDG_CACHE_HOME" );
+    const char * home = std::getenv( "HOME" );
+    if ( cache_home != nullptr && cache_home[0] != '\0' )
+    {
+        return addTrailingSlashIfNeeded( cache_home ) + "lmms-pkg/rsc-index";
+    }
+    else if ( home != nullptr && home[0] != '\0' )
+    {
+        return addTrailingSlashIfNeeded( home ) + ".cache/lmms-pkg/rsc-index";
+    }
+    return "";
+}
+
+
 const ExportOptions retrieveExportInfo( const argparse::ArgumentParser& parser )
 {
     const bool zip = !parser.retrieve<bool>( "no-zip" );
+    const bool stream = parser.retrieve<bool>( "stream" );
+    const bool store_compressed = !parser.retrieve<bool>( "deflate-all" );
     const bool sf2_export = parser.retrieve<bool>( "sf2" );
     const auto& dirs = parser.retrieve<std::vector<std::string> >( "rsc-dirs" );
     const auto& lmms_exe = ( parser.hasParsedArgument( "lmms-exe" ) ? parser.retrieve( "lmms-exe" ) : "lmms" );
     const auto& project_file = fs::normalize( parser.retrieve( "source" ) );
     const bool verbose = parser.retrieve<bool>( "verbose" );
+    const unsigned int jobs = retrieveJobCount( parser );
+    const int level = retrieveCompressionLevel( parser );
+    const std::string& resource_index = retrieveResourceIndexFile( parser );
+    const std::string& update_package = ( parser.hasParsedArgument( "update" ) ? fs::normalize( parser.retrieve( "update" ) ) : "" );
+    const std::string& delta_base = ( parser.hasParsedArgument( "delta" ) ? fs::normalize( parser.retrieve( "delta" ) ) : "" );
     // Some resources can be located in the directory where the project is.
     // It is possible that the path to the resource is relative to the project directory,
     // That is why by default the resource directory contains at least the project directory.
@@ -127,6 +234,11 @@ const ExportOptions retrieveExportInfo( const argparse::ArgumentParser& parser )
     }
 
 
+    if ( stream && !zip )
+    {
+        throw std::invalid_argument( "--stream and --no-zip cannot be used together: the streaming mode writes the package file.\n" );
+    }
+
     if ( verbose && !sf2_export )
     {
         std::cout << "-- Ignore Soundfont2 (SF2) files\n";
@@ -137,11 +249,37 @@ const ExportOptions retrieveExportInfo( const argparse::ArgumentParser& parser )
         std::cout << "-- The destination package will not be zipped\n";
     }
 
+    if ( !store_compressed && verbose )
+    {
+        std::cout << "-- Every file will be deflated, including the already-compressed ones\n";
+    }
+
+    if ( !update_package.empty() && !zip )
+    {
+        throw std::invalid_argument( "--update and --no-zip cannot be used together: only a package file can be updated.\n" );
+    }
+
+    if ( !delta_base.empty() && !zip )
+    {
+        throw std::invalid_argument( "--delta and --no-zip cannot be used together: a delta package is a package file.\n" );
+    }
+
+    if ( stream && verbose )
+    {
+        std::cout << "-- The package will be written without the intermediate package directory\n";
+    }
+
     if ( verbose && parser.hasParsedArgument( "lmms-exe" ) )
     {
         std::cout << "-- LMMS executable: " << lmms_exe << "\n";
     }
 
+    if ( verbose )
+    {
+        std::cout << "-- Jobs: " << jobs << "\n";
+        std::cout << "-- Compression level: " << level << "\n";
+    }
+
     if ( verbose && !resource_dirs.empty() )
     {
         std::cout << "-- The following resource directories have been set: \n";
@@ -151,7 +289,22 @@ const ExportOptions retrieveExportInfo( const argparse::ArgumentParser& parser )
         }
     }
 
-    return ExportOptions { sf2_export, zip, dirs, lmms_exe };
+    if ( verbose && !dirs.empty() )
+    {
+        std::cout << "-- Resource index: " << ( resource_index.empty() ? "none" : resource_index ) << "\n";
+    }
+
+    if ( verbose && !update_package.empty() )
+    {
+        std::cout << "-- Unchanged files are copied from the previous package: " << update_package << "\n";
+    }
+
+    if ( verbose && !delta_base.empty() )
+    {
+        std::cout << "-- Delta package against: " << delta_base << "\n";
+    }
+
+    return ExportOptions { sf2_export, zip, dirs, lmms_exe, jobs, stream, store_compressed, level, resource_index, update_package, delta_base };
 }
 
 /*
@@ -159,8 +312,9 @@ const ExportOptions retrieveExportInfo( const argparse::ArgumentParser& parser )
 
     - $lmms-pkg --check [--verbose] <file>
     - $lmms-pkg --info [--verbose] <file>
-    - $lmms-pkg --export [--no-zip] [--sf2] [--verbose] --target <dir> <file>
-    - $lmms-pkg --import [--verbose] --target <dir> <file>
+    - $lmms-pkg --export [--no-zip | --stream] [--deflate-all] [--level <0-9> | --fast | --best] [--sf2] [--verbose] [--jobs <n>] [--rsc-dirs <dirs>] [--rsc-index <file>] [--update <package>] [--delta <package>] --target <dir> <file>
+    - $lmms-pkg --import [--verbose] [--jobs <n>] [--base <packages>] --target <dir> <file>
+    - $lmms-pkg --batch [--no-zip | --stream] [--deflate-all] [--level <0-9> | --fast | --best] [--sf2] [--verbose] [--jobs <n>] [--rsc-dirs <dirs>] [--rsc-index <file>] <manifest>
 
 */
 const Options retrieveArguments( const int argc, const char * argv[] )
@@ -200,7 +354,21 @@ const Options retrieveArguments( const int argc, const char * argv[] )
         if ( parser.hasParsedArgument( "target" ) )
         {
             const std::string& destination_directory = addTrailingSlashIfNeeded( parser.retrieve( "target" ) );
-            return Options { operation, project_file, destination_directory, verbose, ExportOptions() };
+            const unsigned int jobs = retrieveJobCount( parser );
+            std::vector<std::string> base_packages;
+            if ( parser.hasParsedArgument( "base" ) )
+            {
+                for ( const auto& package : parser.retrieve<std::vector<std::string> >( "base" ) )
+                {
+                    base_packages.push_back( fs::normalize( package ) );
+                }
+            }
+
+            if ( verbose )
+            {
+                std::cout << "-- Jobs: " << jobs << "\n";
+            }
+            return Options { operation, project_file, destination_directory, verbose, ExportOptions(), jobs, base_packages };
         }
         else
         {
@@ -208,6 +376,17 @@ const Options retrieveArguments( const int argc, const char * argv[] )
         }
     }
 
+    // Every project of the manifest is exported with the same options into its own target directory
+    if ( operation == OperationType::Batch )
+    {
+        if ( parser.hasParsedArgument( "target" ) || parser.hasParsedArgument( "update" ) || parser.hasParsedArgument( "delta" ) )
+        {
+            throw std::invalid_argument( "--target, --update and --delta cannot be used in batch mode: they are given per project.\n" );
+        }
+        const ExportOptions& export_opt = retrieveExportInfo( parser );
+        return Options { operation, project_file, "", verbose, export_opt };
+    }
+
     // Normally, this line must be unreachable
     throw std::invalid_argument( "Invalid Operation. Internal error. Please contact a developer.\n" );
 }
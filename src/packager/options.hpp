@@ -31,6 +31,7 @@ enum class OperationType
     Unpack,
     Check,
     Info,
+    Batch,
     InvalidOperation
 };
 
@@ -39,7 +40,14 @@ struct ExportOptions
     const bool sf2_export = true;
     const bool zip = true;
     const std::vector<std::string> resource_directories {};
-    const std::string lmms_command = "";     // Very useful if LMMS is not in the $PATH env
+    const std::string lmms_command = "";     // Fallback for *.mmpz* files. Very useful if LMMS is not in the $PATH env
+    const unsigned int jobs = 1;              // Number of threads used to copy the resources
+    const bool stream = false;                // Write the package directly, without the package directory
+    const bool store_compressed = true;       // Do not deflate files that are already compressed (OGG, FLAC...)
+    const int level = 8;                      // Compression level of the package, from 0 (store only) to 9 (best)
+    const std::string resource_index = "";   // File of the index of the resource directories, not kept if empty
+    const std::string update_package = "";   // Previous package whose unchanged entries are copied as they are
+    const std::string delta_base = "";       // Base package of a delta package, a full package is made if empty
 };
 
 struct Options
@@ -49,6 +57,8 @@ struct Options
     const std::string destination_directory = "";
     const bool verbose = false;
     const ExportOptions export_opt {};
+    const unsigned int jobs = 1;              // Number of threads used to extract the package (Unpack)
+    const std::vector<std::string> base_packages {};    // Full package then deltas the package to unpack is based on (Unpack)
 };
 
 
@@ -21,15 +21,25 @@
 #include "options.hpp"
 #include "mmpz.hpp"
 #include "xml.hpp"
+#include "workers.hpp"
+#include "content_hash.hpp"
+#include "rsc_index.hpp"
 
 #include "../program/printer.hpp"
 #include "../exceptions/exceptions.hpp"
 #include "../external/filesystem/filesystem.hpp"
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <algorithm>
 #include <unordered_set>
 #include <unordered_map>
+#include <map>
+#include <tuple>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 
 using namespace exceptions;
 namespace fsys = ghc::filesystem;
@@ -40,11 +50,10 @@ namespace Packager
 
 /// Export
 
-const std::vector<ghc::filesystem::path> retrieveResourcesFromProject( const ghc::filesystem::path& project_file )
+const std::vector<ghc::filesystem::path> retrieveResourcesFromProject( xml::ProjectDocument& project )
 {
-    const std::vector<std::string>& resources = xml::retrieveResourcesFromXmlFile( project_file.string() );
     std::vector<ghc::filesystem::path> paths;
-    for ( const std::string& resource: resources )
+    for ( const std::string& resource: project.resources() )
     {
         paths.push_back( ghc::filesystem::path( resource ) );
     }
@@ -52,13 +61,111 @@ const std::vector<ghc::filesystem::path> retrieveResourcesFromProject( const ghc
 }
 
 
-const std::vector<ExportedFile> copyExportedFilesTo( const std::vector<ghc::filesystem::path>& paths,
-                                                     const ghc::filesystem::path& resource_directory,
+namespace
+{
+
+/*
+    The index of the resource directories, built at the first call and then shared by every project
+    packaged by the process (several ones in batch mode), from any thread.
+*/
+const rsc::ResourceIndex& resourceIndex( const options::ExportOptions& export_opt )
+{
+    static std::mutex mutex;
+    static std::map<std::pair<std::vector<std::string>, std::string>, std::unique_ptr<rsc::ResourceIndex> > indices;
+
+    const std::lock_guard<std::mutex> lock( mutex );
+    std::unique_ptr<rsc::ResourceIndex>& index = indices[{ export_opt.resource_directories, export_opt.resource_index }];
+    if ( index == nullptr )
+    {
+        index.reset( new rsc::ResourceIndex( export_opt.resource_directories, export_opt.resource_index ) );
+    }
+    return *index;
+}
+
+/*
+    Where a resource of the project actually is (it can be in a resource directory), or an empty path if it is not found.
+    The resource directories are indexed at the first missing resource, then every lookup is done in the index.
+*/
+const fsys::path locateResource( const fsys::path& source_path, const options::Options& options )
+{
+    program::log::Printer print = program::log::getPrinter();
+
+    if ( fsys::exists( source_path ) )
+    {
+        return source_path;
+    }
+
+    if ( !options.export_opt.resource_directories.empty() )
+    {
+        print << "-- Searching for \"" << ghc::filesystem::normalize( source_path.string() )
+                  << "\" in resource directories...\n";
+    }
+    else
+    {
+        std::cerr << "-- FILE NOT FOUND: \"" << ghc::filesystem::normalize( source_path.string() ) << "\".\n";
+        return fsys::path();
+    }
+
+    // Assuming the source_path is relative to the current directory it is located
+    // (example: in LMMS/ or LMMS_Data/)
+    const std::string& lmms_source_file = resourceIndex( options.export_opt ).locate( source_path.string() );
+    if ( !lmms_source_file.empty() )
+    {
+        print << "-- Found \"" << ghc::filesystem::normalize( lmms_source_file ) << "\"\n";
+        return fsys::path( lmms_source_file );
+    }
+
+    std::cerr << "-- FILE NOT FOUND: \"" << ghc::filesystem::normalize( source_path.string() ) << "\".\n";
+    return fsys::path();
+}
+
+/*
+    For every file, the index of the first file that has the same content (its own index if there is none).
+    The sizes are compared first, so only the files that have the same size as another one are read and hashed.
+*/
+const std::vector<std::size_t> sameContentIndices( const std::vector<fsys::path>& locations, const unsigned int jobs )
+{
+    std::vector<std::uintmax_t> sizes;
+    std::unordered_map<std::uintmax_t, std::size_t> size_count;
+    for ( const fsys::path& location : locations )
+    {
+        sizes.push_back( fsys::file_size( location ) );
+        size_count[sizes.back()] += 1;
+    }
+
+    std::vector<std::size_t> hashed;
+    for ( std::size_t i = 0; i < locations.size(); i++ )
+    {
+        if ( size_count[sizes[i]] > 1 )
+        {
+            hashed.push_back( i );
+        }
+    }
+
+    std::vector<content::Hash> hashes( locations.size() );
+    workers::runParallel( hashed.size(), jobs, [&] ( const std::size_t k )
+    {
+        hashes[hashed[k]] = content::fileHash( locations[hashed[k]].string() );
+    } );
+
+    std::map<std::tuple<std::uintmax_t, std::uint64_t, std::uint64_t>, std::size_t> first_indices;
+    std::vector<std::size_t> indices;
+    for ( std::size_t i = 0; i < locations.size(); i++ )
+    {
+        const auto& key = std::make_tuple( sizes[i], hashes[i].low, hashes[i].high );
+        indices.push_back( size_count[sizes[i]] > 1 ? first_indices.emplace( key, i ).first->second : i );
+    }
+    return indices;
+}
+
+}
+
+const std::vector<ExportedFile> locateExportedFiles( const std::vector<ghc::filesystem::path>& paths,
                                                      const std::vector<std::string>& duplicated_filenames,
                                                      const options::Options& options )
 {
-    std::vector<ExportedFile> exported_files;
-    std::unordered_map<std::string, int> name_counter;
+    std::vector<fsys::path> sources;
+    std::vector<fsys::path> locations;
     program::log::Printer print = program::log::getPrinter();
 
     for ( const fsys::path& source_path : paths )
@@ -69,69 +176,87 @@ const std::vector<ExportedFile> copyExportedFilesTo( const std::vector<ghc::file
         }
         else
         {
-            const std::string& src_pathname = source_path.stem().string();
-            const fsys::path& destination_path = [&] ()
+            const fsys::path& location = locateResource( source_path, options );
+            if ( !location.empty() )
             {
-                if ( std::find( duplicated_filenames.cbegin(), duplicated_filenames.cend(), src_pathname ) != duplicated_filenames.cend() )
-                {
-                    if ( name_counter.find( src_pathname ) != name_counter.end() )
-                    {
-                        name_counter[src_pathname] += 1;
-                    }
-                    else
-                    {
-                        name_counter[src_pathname] = 1;
-                    }
-
-                    return fsys::path( resource_directory.string() + source_path.stem().string()
-                                       + "-" + std::to_string( name_counter[src_pathname] ) + source_path.extension().string() );
-                }
-                else
-                {
-                    return fsys::path( resource_directory.string() + source_path.filename().string() );
-                }
-            } ();
-
-            if ( fsys::exists( source_path ) )
+                sources.push_back( source_path );
+                locations.push_back( location );
+            }
+        }
+    }
+
+    // Identical files are exported once: only the files with a distinct content need a distinct name
+    const std::vector<std::size_t>& first_indices = sameContentIndices( locations, options.export_opt.jobs );
+    std::unordered_map<std::string, int> stored_names;
+    for ( std::size_t i = 0; i < sources.size(); i++ )
+    {
+        stored_names[sources[i].stem().string()] += ( first_indices[i] == i ) ? 1 : 0;
+    }
+
+    std::vector<ExportedFile> exported_files;
+    std::unordered_map<std::string, int> name_counter;
+    for ( std::size_t i = 0; i < sources.size(); i++ )
+    {
+        const fsys::path& source_path = sources[i];
+        if ( first_indices[i] != i )
+        {
+            const ExportedFile& stored_file = exported_files[first_indices[i]];
+            print << "-- \"" << ghc::filesystem::normalize( source_path.string() ) << "\" has the same content as \""
+                  << ghc::filesystem::normalize( stored_file.source.string() ) << "\".\n";
+            exported_files.push_back( ExportedFile{ source_path, stored_file.dest, locations[i], true } );
+            continue;
+        }
+
+        const std::string& src_pathname = source_path.stem().string();
+        const fsys::path& destination_path = [&] ()
+        {
+            if ( stored_names[src_pathname] > 1 &&
+                 std::find( duplicated_filenames.cbegin(), duplicated_filenames.cend(), src_pathname ) != duplicated_filenames.cend() )
             {
-                print << "-- Copying \"" << ghc::filesystem::normalize( source_path.string() )
-                      << "\" -> \"" << ghc::filesystem::normalize( destination_path.string() ) << "\"...";
-                fsys::copy_file( source_path, destination_path );
-                exported_files.push_back( ExportedFile{ source_path, destination_path.filename() } );
-                print << "DONE\n";
+                name_counter[src_pathname] += 1;
+                return fsys::path( source_path.stem().string() + "-" + std::to_string( name_counter[src_pathname] )
+                                   + source_path.extension().string() );
             }
             else
             {
-                bool found = false;
-                if ( !options.export_opt.resource_directories.empty() )
-                {
-                    print << "-- Searching for \"" << ghc::filesystem::normalize( source_path.string() )
-                              << "\" in resource directories...\n";
-                }
-
-                for ( const std::string& dir : options.export_opt.resource_directories )
-                {
-                    // Assuming the source_path is relative to the current directory it is located
-                    // (example: in LMMS/ or LMMS_Data/)
-                    const fsys::path& lmms_source_file = fsys::path( dir + source_path.string() );
-                    if ( fsys::exists( lmms_source_file ) )
-                    {
-                        print << "-- Found \"" << ghc::filesystem::normalize( lmms_source_file.string() ) << "\"\n";
-                        print << "-- Copying \"" << ghc::filesystem::normalize( lmms_source_file.string() ) << "\" -> \""
-                              << ghc::filesystem::normalize( destination_path.string() ) << "\"...";
-                        fsys::copy_file( lmms_source_file, destination_path );
-                        exported_files.push_back( ExportedFile{ source_path, destination_path.filename() } );
-                        print << "DONE\n";
-                        found = true;
-                        break;
-                    }
-                }
-                if ( !found )
-                {
-                    std::cerr << "-- FILE NOT FOUND: \"" << ghc::filesystem::normalize( source_path.string() ) << "\".\n";
-                }
+                return source_path.filename();
             }
+        } ();
+
+        exported_files.push_back( ExportedFile{ source_path, destination_path, locations[i] } );
+    }
+
+    return exported_files;
+}
+
+
+const std::vector<ExportedFile> copyExportedFilesTo( const std::vector<ghc::filesystem::path>& paths,
+                                                     const ghc::filesystem::path& resource_directory,
+                                                     const std::vector<std::string>& duplicated_filenames,
+                                                     const options::Options& options )
+{
+    // The destination names and the lookup into the resource directories are resolved sequentially,
+    // so the "-N" suffixes and the order of the exported files do not depend on the number of jobs
+    const std::vector<ExportedFile>& exported_files = locateExportedFiles( paths, duplicated_filenames, options );
+    program::log::Printer print = program::log::getPrinter();
+
+    // Every file has its own destination, so the copies are independent from each other
+    workers::runParallel( exported_files.size(), options.export_opt.jobs, [&] ( const std::size_t i )
+    {
+        if ( !exported_files[i].duplicate )
+        {
+            fsys::copy_file( exported_files[i].location, fsys::path( resource_directory.string() + exported_files[i].dest.string() ) );
         }
+    } );
+
+    for ( const ExportedFile& file : exported_files )
+    {
+        if ( file.duplicate )
+        {
+            continue;
+        }
+        print << "-- Copied \"" << ghc::filesystem::normalize( file.location.string() ) << "\" -> \""
+              << ghc::filesystem::normalize( resource_directory.string() + file.dest.string() ) << "\"\n";
     }
     return exported_files;
 }
@@ -144,7 +269,7 @@ const ghc::filesystem::path copyProjectToDestinationDirectory( const ghc::filesy
 
     if ( fsys::hasExtension ( lmms_file, ".mmpz" ) )
     {
-        print << "-- This is a compressed project. Using LMMS to decompress it...\n";
+        print << "-- This is a compressed project. Decompressing it...\n";
         return lmms::decompressProject( project_file, destination_directory, options.export_opt.lmms_command );
     }
     else
@@ -165,6 +290,29 @@ const ghc::filesystem::path copyProjectToDestinationDirectory( const ghc::filesy
     }
 }
 
+const std::string readProjectContent( const ghc::filesystem::path& lmms_file, const options::Options& options )
+{
+    program::log::Printer print = program::log::getPrinter();
+
+    if ( fsys::hasExtension ( lmms_file, ".mmpz" ) )
+    {
+        print << "-- This is a compressed project. Decompressing it...\n";
+        return lmms::decompressProjectContent( options.project_file, options.export_opt.lmms_command );
+    }
+    else
+    {
+        std::ifstream infile( lmms_file.string(), std::ios::binary );
+        if ( !infile )
+        {
+            throw NonExistingFileException( "ERROR: Cannot read \"" + ghc::filesystem::normalize( lmms_file.string() ) + "\".\n" );
+        }
+
+        std::stringstream ss;
+        ss << infile.rdbuf();
+        return ss.str();
+    }
+}
+
 
 const std::vector<std::string> getDuplicatedFilenames( const std::vector<ghc::filesystem::path> paths ) noexcept
 {
@@ -186,9 +334,11 @@ const std::vector<std::string> getDuplicatedFilenames( const std::vector<ghc::fi
     return duplicated_names;
 }
 
-void configureExportedProject( const ghc::filesystem::path& project_file, const std::vector<ExportedFile>& exported_files )
+void configureExportedProject( xml::ProjectDocument& project, const ghc::filesystem::path& project_file,
+                               const std::vector<ExportedFile>& exported_files )
 {
-    xml::configureExportedXmlFile( project_file.string(), exported_files );
+    project.configureExportedFiles( exported_files );
+    project.saveFile( project_file.string() );
 }
 
 
@@ -27,6 +27,11 @@ namespace options
 struct Options;
 }
 
+namespace xml
+{
+class ProjectDocument;
+}
+
 namespace ghc
 {
 namespace filesystem
@@ -39,17 +44,22 @@ class path;
 namespace Packager
 {
 
-const std::vector<ghc::filesystem::path> retrieveResourcesFromProject( const ghc::filesystem::path& project_file );
+const std::vector<ghc::filesystem::path> retrieveResourcesFromProject( xml::ProjectDocument& project );
+const std::vector<ExportedFile> locateExportedFiles( const std::vector<ghc::filesystem::path>& paths,
+                                                     const std::vector<std::string>& duplicated_filenames,
+                                                     const options::Options& options );
 const std::vector<ExportedFile> copyExportedFilesTo( const std::vector<ghc::filesystem::path>& paths,
                                                                         const ghc::filesystem::path& resource_directory,
                                                                         const std::vector<std::string>& duplicated_filenames,
                                                                         const options::Options& options );
 
 const ghc::filesystem::path copyProjectToDestinationDirectory( const ghc::filesystem::path& lmms_file, const options::Options& options );
+const std::string readProjectContent( const ghc::filesystem::path& lmms_file, const options::Options& options );
 
 const std::vector<std::string> getDuplicatedFilenames(const std::vector<ghc::filesystem::path> paths) noexcept;
 
-void configureExportedProject( const ghc::filesystem::path& project_file, const std::vector<ExportedFile>& exported_files );
+void configureExportedProject( xml::ProjectDocument& project, const ghc::filesystem::path& project_file,
+                               const std::vector<ExportedFile>& exported_files );
 
 const std::vector<ghc::filesystem::path> getProjectResourcePaths( const ghc::filesystem::path& project_directory );
 void configureImportedProject( const ghc::filesystem::path& project_file, const std::vector<ghc::filesystem::path>& resources );
@@ -21,11 +21,14 @@
 #include "options.hpp"
 #include "mmpz.hpp"
 #include "exported_file.hpp"
+#include "xml.hpp"
+#include "delta.hpp"
 #include "../program/printer.hpp"
 #include "../exceptions/exceptions.hpp"
 #include "../external/filesystem/filesystem.hpp"
 
 #include <iostream>
+#include <algorithm>
 
 using namespace exceptions;
 namespace fsys = ghc::filesystem;
@@ -33,6 +36,66 @@ namespace fsys = ghc::filesystem;
 namespace Packager
 {
 
+namespace
+{
+
+// Files with the same content as another one are stored once
+std::size_t storedFileCount( const std::vector<ExportedFile>& exported_files )
+{
+    return std::count_if( exported_files.cbegin(), exported_files.cend(), [] ( const ExportedFile& f )
+    {
+        return !f.duplicate;
+    } );
+}
+
+const std::string streamPack( const options::Options& options )
+{
+    const fsys::path lmms_file( options.project_file );
+    const fsys::path package_directory( options.destination_directory );
+    const fsys::path package_file( lmms::packageFile( package_directory ) );
+    program::log::Printer print = program::log::getPrinter();
+
+    if ( fsys::exists( package_file ) )
+    {
+        throw AlreadyExistingFileException( "ERROR: \"" + fsys::normalize( package_file.string() ) +
+                                            "\" already exists. You need to export to a fresh location.\n" );
+    }
+
+    // The project is parsed once, then checked, queried and configured
+    xml::ProjectDocument project;
+    project.parse( readProjectContent( lmms_file, options ) );
+    if ( !project.isValidProject() )
+    {
+        throw InvalidXmlFileException( "ERROR: Invalid XML file: \"" + fsys::normalize( lmms_file.string() )
+                                       + "\". Packaging aborted.\n" );
+    }
+
+    print << "-- Retrieving files to package...\n";
+    const std::vector<fsys::path>& sound_files = retrieveResourcesFromProject( project );
+    const std::vector<std::string>& dup_files = getDuplicatedFilenames( sound_files );
+
+    print << "\n-- This project has " << sound_files.size() << " file(s) that can be packaged.\n\n";
+
+    const std::vector<ExportedFile>& exported_files = locateExportedFiles( sound_files, dup_files, options );
+    project.configureExportedFiles( exported_files );
+    const std::string& configured_content = project.content();
+    // A compressed project is stored as a plain XML file, like in the non-streaming mode
+    const std::string& project_filename = fsys::hasExtension( lmms_file, ".mmpz" ) ?
+                                          lmms_file.stem().string() + ".mmp" : lmms_file.filename().string();
+
+    if ( !package_file.parent_path().empty() && !fsys::exists( package_file.parent_path() ) )
+    {
+        print << "-- Creating path: " << package_file.parent_path().string() << "\n";
+        fsys::create_directories( package_file.parent_path() );
+    }
+
+    lmms::zipExportedProject( package_directory, project_filename, configured_content, exported_files, options.export_opt );
+    print << "-- " << storedFileCount( exported_files ) << " file(s) packaged.\n\n";
+    return fsys::normalize( package_file.string() );
+}
+
+}
+
 const std::string pack( const options::Options& options )
 {
     const std::string& project_file = options.project_file;
@@ -47,6 +110,23 @@ const std::string pack( const options::Options& options )
         throw NonExistingFileException( "ERROR: \"" + lmms_file.string() + "\" does not exist.\n" );
     }
 
+    const std::string& update_package = options.export_opt.update_package;
+    if ( !update_package.empty() && !fsys::is_regular_file( update_package ) )
+    {
+        throw NonExistingFileException( "ERROR: The package to update \"" + update_package + "\" does not exist.\n" );
+    }
+
+    const std::string& delta_base = options.export_opt.delta_base;
+    if ( !delta_base.empty() && !fsys::is_regular_file( delta_base ) )
+    {
+        throw NonExistingFileException( "ERROR: The base package \"" + delta_base + "\" does not exist.\n" );
+    }
+
+    if ( options.export_opt.stream )
+    {
+        return streamPack( options );
+    }
+
     bool dirtectory_created_by_app = false;
     if ( !fsys::exists( package_directory ) )
     {
@@ -66,7 +146,10 @@ const std::string pack( const options::Options& options )
         throw NonExistingFileException( "ERROR: \"" + dest_project_file.string() + "\" does not exist. Packaging aborted.\n" );
     }
 
-    if ( !lmms::checkLMMSProjectFile( dest_project_file ) )
+    // The project is parsed once, then checked, queried, configured and saved
+    xml::ProjectDocument project;
+    project.loadFile( dest_project_file.string() );
+    if ( !project.isValidProject() )
     {
         std::error_code ecfile;
         fsys::remove( dest_project_file, ecfile );
@@ -82,7 +165,7 @@ const std::string pack( const options::Options& options )
     }
 
     print << "-- Retrieving files to copy...\n";
-    const std::vector<fsys::path>& sound_files = retrieveResourcesFromProject( dest_project_file.string() );
+    const std::vector<fsys::path>& sound_files = retrieveResourcesFromProject( project );
     const std::vector<std::string>& dup_files = getDuplicatedFilenames( sound_files );
 
     print << "\n-- This project has " << sound_files.size() << " file(s) that can be copied.\n\n";
@@ -97,10 +180,10 @@ const std::string pack( const options::Options& options )
         }
 
         const auto& copied_files = Packager::copyExportedFilesTo( sound_files, resource_directory.string(), dup_files, options );
-        print << "-- " << copied_files.size() << " file(s) copied.\n\n";
+        print << "-- " << storedFileCount( copied_files ) << " file(s) copied.\n\n";
 
-        configureExportedProject( dest_project_file, copied_files );
-        return fsys::normalize(options.export_opt.zip ? lmms::zipFile( package_directory ).string() : package_directory.string());
+        configureExportedProject( project, dest_project_file, copied_files );
+        return fsys::normalize(options.export_opt.zip ? lmms::zipFile( package_directory, options.export_opt ).string() : package_directory.string());
     }
     else
     {
@@ -119,6 +202,14 @@ const std::string unpack( const options::Options& options )
     const fsys::path destination_directory( options.destination_directory );
     program::log::Printer print = program::log::getPrinter();
 
+    for ( const std::string& file : options.base_packages )
+    {
+        if ( !fsys::exists( file ) )
+        {
+            throw NonExistingFileException( "ERROR: \"" + file + "\" does not exist.\n" );
+        }
+    }
+
     if ( !fsys::exists( package ) )
     {
         throw NonExistingFileException( "ERROR: \"" + package.string() + "\" does not exist.\n" );
@@ -127,12 +218,25 @@ const std::string unpack( const options::Options& options )
     if ( lmms::checkZipFile( package.string() ) )
     {
         print << "-- Package is OK.\n\n";
+
+        // A delta package only has the resources that changed since its base
+        delta::Descriptor descriptor;
+        if ( options.base_packages.empty() && delta::readDescriptor( package.string(), descriptor ) )
+        {
+            throw PackageImportException( "ERROR: \"" + fsys::normalize( package.string() ) + "\" is a delta package of \""
+                                          + descriptor.base_name + "\". Please give its base packages with --base.\n" );
+        }
+
         if ( !fsys::exists( destination_directory ) )
         {
             fsys::create_directories( destination_directory );
         }
 
-        const fsys::path project_file( lmms::unzipFile( package, destination_directory ) );
+        std::vector<std::string> chain( options.base_packages );
+        chain.push_back( package.string() );
+        const fsys::path project_file( options.base_packages.empty() ?
+                                       lmms::unzipFile( package, destination_directory, options.jobs ) :
+                                       delta::unzipChain( chain, destination_directory, options.jobs ) );
         print << "-- Package extracted into \"" << fsys::normalize( destination_directory.string() ) << "\".\n";
 
         const fsys::path backup_file( project_file.string() + ".backup" );
@@ -32,6 +32,7 @@ const std::string pack( const options::Options& options );
 const std::string unpack( const options::Options& options );
 bool checkPackage( const options::Options& options );
 bool packageInfo( const options::Options& options );
+bool batchPack( const options::Options& options );
 };
 
 #endif // PACKAGER_HPP_INCLUDED
@@ -0,0 +1,304 @@
+/*
+*   LMMS Project Packager
+*   Copyright © 2022 Luxon Jean-Pierre
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rsc_index.hpp"
+#include "../external/filesystem/filesystem.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+namespace fsys = ghc::filesystem;
+
+namespace rsc
+{
+
+namespace
+{
+
+const std::string INDEX_HEADER = "lmms-pkg resource index 2";
+
+long long seconds( const fsys::file_time_type& t ) noexcept
+{
+    return std::chrono::duration_cast<std::chrono::seconds>( t.time_since_epoch() ).count();
+}
+
+// The canonical path of a resource directory, whatever the working directory it is given from
+const std::string canonicalRoot( const std::string& directory )
+{
+    std::error_code ec;
+    const fsys::path& root = fsys::weakly_canonical( fsys::absolute( directory, ec ), ec );
+    return ec ? fsys::absolute( directory ).lexically_normal().string() : root.string();
+}
+
+// The path of a resource relative to a resource directory, as it is appended to the directory
+const std::string relativeKey( const std::string& source )
+{
+    const std::size_t start = source.find_first_not_of( '/' );
+    return ( start == std::string::npos ) ? "" : fsys::path( source.substr( start ) ).lexically_normal().generic_string();
+}
+
+// Split a line of the index into "count" fields separated by tabs, the last one takes the rest of the line
+bool splitFields( const std::string& line, const std::size_t count, std::vector<std::string>& fields )
+{
+    fields.clear();
+    std::size_t pos = 0;
+    while ( fields.size() + 1 < count )
+    {
+        const std::size_t tab = line.find( '\t', pos );
+        if ( tab == std::string::npos )
+        {
+            return false;
+        }
+        fields.push_back( line.substr( pos, tab - pos ) );
+        pos = tab + 1;
+    }
+    fields.push_back( line.substr( pos ) );
+    return true;
+}
+
+}
+
+ResourceIndex::ResourceIndex( const std::vector<std::string>& resource_directories, const std::string& file )
+    : directories( resource_directories ), index_file( file )
+{
+    const long long now = seconds( fsys::file_time_type::clock::now() );
+    bool changed = !load();
+    for ( const std::string& directory : directories )
+    {
+        roots.push_back( canonicalRoot( directory ) );
+        changed = refresh( roots.back(), trees[roots.back()] ) || changed;
+    }
+
+    if ( changed )
+    {
+        indexed_at = now;
+        save();
+    }
+
+    for ( const std::string& root : roots )
+    {
+        relative_paths.emplace_back();
+        for ( const auto& entry : trees[root] )
+        {
+            for ( const std::string& name : entry.second.files )
+            {
+                relative_paths.back().insert( entry.first + name );
+            }
+        }
+    }
+}
+
+bool ResourceIndex::load()
+{
+    std::ifstream infile( index_file, std::ios::binary );
+    std::string line;
+    std::vector<std::string> fields;
+    if ( index_file.empty() || !infile || !std::getline( infile, line ) || !splitFields( line, 2, fields )
+         || fields[0] != INDEX_HEADER )
+    {
+        return false;
+    }
+
+    try
+    {
+        indexed_at = std::stoll( fields[1] );
+        Tree * tree = nullptr;
+        Directory * directory = nullptr;
+        while ( std::getline( infile, line ) )
+        {
+            const char kind = line.empty() ? '\0' : line[0];
+            const std::string& content = ( line.size() < 2 || line[1] != '\t' ) ? "" : line.substr( 2 );
+
+            if ( kind == 'R' )
+            {
+                tree = &trees[content];
+                directory = nullptr;
+            }
+            else if ( kind == 'D' && tree != nullptr && splitFields( content, 2, fields ) )
+            {
+                directory = &( *tree )[fields[1]];
+                directory->mtime = std::stoll( fields[0] );
+            }
+            else if ( kind == 'S' && directory != nullptr )
+            {
+                directory->subdirectories.push_back( content );
+            }
+            else if ( kind == 'F' && directory != nullptr )
+            {
+                directory->files.push_back( content );
+            }
+            else
+            {
+                throw std::invalid_argument( line );
+            }
+        }
+    }
+    catch ( const std::exception& )
+    {
+        trees.clear();
+        indexed_at = 0;
+        return false;
+    }
+    return true;
+}
+
+/*
+    Update the tree of a resource directory. A directory is listed again if its modification time has changed,
+    or if it was modified at the time it was indexed (a change during the same second would not be visible).
+    Return true if anything was listed again or has disappeared.
+*/
+bool ResourceIndex::refresh( const std::string& directory, Tree& tree ) const
+{
+    Tree refreshed;
+    bool changed = false;
+    std::vector<std::string> pending{ "" };
+
+    while ( !pending.empty() )
+    {
+        const std::string relative = pending.back();
+        const fsys::path path = fsys::path( directory ) / relative;
+        pending.pop_back();
+
+        std::error_code ec;
+        const long long mtime = seconds( fsys::last_write_time( path, ec ) );
+        if ( ec || !fsys::is_directory( path, ec ) )
+        {
+            continue;
+        }
+
+        const auto known = tree.find( relative );
+        Directory current{ mtime, {}, {} };
+        if ( known != tree.cend() && known->second.mtime == mtime && mtime < indexed_at )
+        {
+            current = known->second;
+        }
+        else
+        {
+            changed = true;
+            for ( fsys::directory_iterator it( path, ec ), end; !ec && it != end; it.increment( ec ) )
+            {
+                const std::string& name = it->path().filename().string();
+                std::error_code entry_ec;
+                if ( name.find( '\n' ) != std::string::npos )
+                {
+                    continue;
+                }
+
+                // Like recursive_directory_iterator, the links to directories are not followed
+                if ( it->is_directory( entry_ec ) && !it->is_symlink( entry_ec ) )
+                {
+                    current.subdirectories.push_back( name );
+                }
+                else if ( it->is_regular_file( entry_ec ) )
+                {
+                    current.files.push_back( name );
+                }
+            }
+            std::sort( current.subdirectories.begin(), current.subdirectories.end() );
+            std::sort( current.files.begin(), current.files.end() );
+        }
+
+        for ( const std::string& subdirectory : current.subdirectories )
+        {
+            pending.push_back( relative + subdirectory + "/" );
+        }
+        refreshed.emplace( relative, std::move( current ) );
+    }
+
+    changed = changed || refreshed.size() != tree.size();
+    tree = std::move( refreshed );
+    return changed;
+}
+
+void ResourceIndex::save() const
+{
+    if ( index_file.empty() )
+    {
+        return;
+    }
+
+    std::error_code ec;
+    const fsys::path index_path( index_file );
+    if ( !index_path.parent_path().empty() )
+    {
+        fsys::create_directories( index_path.parent_path(), ec );
+    }
+
+    // The index is replaced at once, so an interrupted run never leaves a truncated index
+    const std::string tmp_file = index_file + ".tmp";
+    std::ofstream outfile( tmp_file, std::ios::binary | std::ios::trunc );
+    outfile << INDEX_HEADER << "\t" << indexed_at << "\n";
+    for ( const auto& tree : trees )
+    {
+        outfile << "R\t" << tree.first << "\n";
+        for ( const auto& entry : tree.second )
+        {
+            outfile << "D\t" << entry.second.mtime << "\t" << entry.first << "\n";
+            for ( const std::string& subdirectory : entry.second.subdirectories )
+            {
+                outfile << "S\t" << subdirectory << "\n";
+            }
+            for ( const std::string& name : entry.second.files )
+            {
+                outfile << "F\t" << name << "\n";
+            }
+        }
+    }
+    outfile.close();
+
+    if ( !outfile )
+    {
+        fsys::remove( tmp_file, ec );
+    }
+    else
+    {
+        fsys::rename( tmp_file, index_path, ec );
+    }
+
+    if ( !outfile || ec )
+    {
+        std::cerr << "-- Cannot save the resource index \"" << fsys::normalize( index_file ) << "\".\n";
+    }
+}
+
+const std::string ResourceIndex::locate( const std::string& source ) const
+{
+    const std::string& key = relativeKey( source );
+    if ( key.empty() )
+    {
+        return "";
+    }
+
+    // Out of the resource directories: probed like the resource directories were before the index
+    const bool outside = key == ".." || key.compare( 0, 3, "../" ) == 0;
+    for ( std::size_t i = 0; i < directories.size(); i++ )
+    {
+        std::error_code ec;
+        const std::string& path = outside ? directories[i] + source : ( fsys::path( directories[i] ) / key ).string();
+        if ( ( outside || relative_paths[i].find( key ) != relative_paths[i].cend() ) && fsys::is_regular_file( path, ec ) )
+        {
+            return path;
+        }
+    }
+    return "";
+}
+
+}
@@ -0,0 +1,82 @@
+/*
+*   LMMS Project Packager
+*   Copyright © 2022 Luxon Jean-Pierre
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RSC_INDEX_HPP_INCLUDED
+#define RSC_INDEX_HPP_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+namespace rsc
+{
+
+/**
+    Index of the files of the resource directories (--rsc-dirs), used to resolve the missing resources
+    of a project in memory instead of probing every resource directory for every resource.
+
+    The index is kept in a file between the runs, where the resource directories are known by their
+    canonical path, so that a relative directory given from another working directory is not mistaken
+    for another one. When it is loaded, only the directories whose modification time has changed are
+    listed again; the other ones are taken from the file, so an unchanged tree costs one stat per directory
+    instead of one per resource and per directory.
+    An index file that cannot be read is rebuilt, an index that cannot be saved only lives for the run.
+*/
+class ResourceIndex final
+{
+private:
+    struct Directory
+    {
+        long long mtime;
+        std::vector<std::string> subdirectories;    // names
+        std::vector<std::string> files;             // names
+    };
+
+    // Relative path of a directory in a resource directory ("" for the resource directory itself, else "a/b/")
+    using Tree = std::map<std::string, Directory>;
+
+    const std::vector<std::string> directories;
+    const std::string index_file;
+    std::vector<std::string> roots;                                 // canonical path of every resource directory
+    std::map<std::string, Tree> trees;                              // by canonical path
+    long long indexed_at = 0;
+    std::vector<std::unordered_set<std::string>> relative_paths;   // per resource directory
+
+    bool load();
+    bool refresh( const std::string& directory, Tree& tree ) const;
+    void save() const;
+
+public:
+    ResourceIndex( const std::vector<std::string>& resource_directories, const std::string& file );
+    ResourceIndex( const ResourceIndex& ) = delete;
+    ResourceIndex& operator =( const ResourceIndex& ) = delete;
+
+    /*
+        Path of the resource in the first resource directory that has it at the same relative path,
+        and where it still exists. A path that goes out of the resource directory ("..") is not indexed,
+        it is looked for on the disk as it is appended to every resource directory.
+        Return an empty string if the resource is not found.
+    */
+    const std::string locate( const std::string& source ) const;
+    ~ResourceIndex() = default;
+};
+
+}
+
+#endif // RSC_INDEX_HPP_INCLUDED
@@ -0,0 +1,48 @@
+/*
+*   LMMS Project Packager
+*   Copyright © 2022 Luxon Jean-Pierre
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WORKERS_HPP_INCLUDED
+#define WORKERS_HPP_INCLUDED
+
+#include <cstddef>
+
+namespace workers
+{
+
+/**
+    Number of jobs used when the user does not provide one (--jobs).
+    It is the number of hardware threads, or 1 if it cannot be detected.
+*/
+unsigned int defaultJobCount() noexcept;
+
+/**
+    Run task(i) for every i in [0, count) on at most "jobs" threads.
+
+    Indices are dispatched dynamically, so the caller must not rely on any execution order,
+    but every task must write its result into its own slot (e.g. results[i]) in order to keep a deterministic output.
+    If a task throws, the remaining tasks are not started and the first exception is rethrown
+    in the calling thread once every worker is done.
+*/
+template<typename Task>
+void runParallel( const std::size_t count, const unsigned int jobs, const Task& task );
+
+}
+
+#include "workers.tpp"
+
+#endif // WORKERS_HPP_INCLUDED
@@ -0,0 +1,85 @@
+/*
+*   LMMS Project Packager
+*   Copyright © 2022 Luxon Jean-Pierre
+*
+*   This program is free software: you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation, either version 3 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License
+*   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <exception>
+
+namespace workers
+{
+
+inline unsigned int defaultJobCount() noexcept
+{
+    const unsigned int hw = std::thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+template<typename Task>
+void runParallel( const std::size_t count, const unsigned int jobs, const Task& task )
+{
+    const std::size_t nthreads = std::min<std::size_t>( std::max( jobs, 1U ), count );
+
+    if ( nthreads <= 1 )
+    {
+        for ( std::size_t i = 0; i < count; i++ )
+        {
+            task( i );
+        }
+        return;
+    }
+
+    std::atomic<std::size_t> next_index( 0 );
+    std::vector<std::exception_ptr> errors( nthreads );
+    std::vector<std::thread> threads;
+
+    for ( std::size_t t = 0; t < nthreads; t++ )
+    {
+        threads.emplace_back( [&, t] ()
+        {
+            try
+            {
+                for ( std::size_t i = next_index++; i < count; i = next_index++ )
+                {
+                    task( i );
+                }
+            }
+            catch ( ... )
+            {
+                errors[t] = std::current_exception();
+                next_index = count;
+            }
+        } );
+    }
+
+    for ( std::thread& thread : threads )
+    {
+        thread.join();
+    }
+
+    for ( const std::exception_ptr& error : errors )
+    {
+        if ( error )
+        {
+            std::rethrow_exception( error );
+        }
+    }
+}
+
+}
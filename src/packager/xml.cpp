@@ -24,6 +24,13 @@
 #include "../external/filesystem/filesystem.hpp"
 
 #include <unordered_set>
+#include <string_view>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <array>
+#include <algorithm>
 
 using namespace exceptions;
 namespace fsys = ghc::filesystem;
@@ -31,7 +38,432 @@ namespace fsys = ghc::filesystem;
 namespace xml
 {
 
-bool checkLMMSProjectBuffer( const std::unique_ptr<char []>& buffer, const unsigned int bufsize )
+namespace
+{
+
+/*
+    LMMS writes the <head> element first in the root element, and the root and <head> hold everything
+    that is needed to check a project or to describe it.
+    Return the size of the beginning of the document that ends with the <head> element, and the name of the root
+    element that must be closed after it. 0 is returned if the document does not start like that.
+*/
+std::size_t projectHeadSize( const char * buffer, const std::size_t bufsize, std::string& root_name )
+{
+    const std::string_view text( buffer, std::find( buffer, buffer + bufsize, '\0' ) - buffer );
+    const std::size_t npos = std::string_view::npos;
+    std::size_t pos = 0;
+
+    // Position after the '>' that ends the tag starting at p, or npos
+    const auto tagEnd = [&text, npos] ( std::size_t p )
+    {
+        char quote = 0;
+        for ( ; p < text.size(); ++p )
+        {
+            const char c = text[p];
+            if ( quote != 0 )
+            {
+                quote = ( c == quote ) ? 0 : quote;
+            }
+            else if ( c == '"' || c == '\'' )
+            {
+                quote = c;
+            }
+            else if ( c == '>' )
+            {
+                return p + 1;
+            }
+        }
+        return npos;
+    };
+
+    // Skip the spaces, comments, processing instructions and doctype before the next element
+    const auto skipMisc = [&text, &pos, &tagEnd, npos] ()
+    {
+        while ( ( pos = text.find_first_not_of( " \t\r\n", pos ) ) != npos )
+        {
+            if ( text.compare( pos, 4, "<!--" ) == 0 )
+            {
+                const std::size_t end = text.find( "-->", pos + 4 );
+                pos = ( end == npos ) ? npos : end + 3;
+            }
+            else if ( text.compare( pos, 2, "<?" ) == 0 )
+            {
+                const std::size_t end = text.find( "?>", pos + 2 );
+                pos = ( end == npos ) ? npos : end + 2;
+            }
+            else if ( text.compare( pos, 2, "<!" ) == 0 )
+            {
+                const std::size_t end = tagEnd( pos );
+                // A doctype with an internal subset is not expected in a project
+                pos = ( end == npos || text.substr( pos, end - pos ).find( '[' ) != npos ) ? npos : end;
+            }
+            else
+            {
+                return text[pos] == '<';
+            }
+        }
+        return false;
+    };
+
+    const auto tagName = [&text] ( const std::size_t p )
+    {
+        const std::size_t end = text.find_first_of( " \t\r\n/>", p + 1 );
+        return text.substr( p + 1, ( end == std::string_view::npos ? text.size() : end ) - p - 1 );
+    };
+
+    if ( !skipMisc() )
+    {
+        return 0;
+    }
+
+    const std::size_t root_end = tagEnd( pos );
+    if ( root_end == npos )
+    {
+        return 0;
+    }
+
+    if ( text[root_end - 2] == '/' )
+    {
+        root_name.clear();
+        return root_end;
+    }
+    root_name = std::string( tagName( pos ) );
+
+    pos = root_end;
+    if ( !skipMisc() || tagName( pos ) != "head" )
+    {
+        return 0;
+    }
+
+    const std::size_t head_end = tagEnd( pos );
+    if ( head_end == npos || text[head_end - 2] == '/' )
+    {
+        return head_end == npos ? 0 : head_end;
+    }
+
+    const std::size_t close = text.find( "</head", head_end );
+    const std::size_t close_end = ( close == npos ) ? npos : tagEnd( close );
+    return close_end == npos ? 0 : close_end;
+}
+
+// Parse only the root element and its <head> if possible, or else the whole document
+tinyxml2::XMLError parseProjectHead( tinyxml2::XMLDocument& doc, const char * buffer, const std::size_t bufsize )
+{
+    std::string root_name;
+    const std::size_t head_size = projectHeadSize( buffer, bufsize, root_name );
+    if ( head_size == 0 )
+    {
+        return doc.Parse( buffer, bufsize );
+    }
+
+    const std::string& head = std::string( buffer, head_size ) + ( root_name.empty() ? "" : "</" + root_name + ">" );
+    return doc.Parse( head.c_str(), head.size() );
+}
+
+// Elements that refer to a resource with their "src" attribute
+const std::vector<std::string> RESOURCE_NAMES{ "audiofileprocessor", "sf2player", "sampletco" };
+
+// Resource paths, without duplicates nor empty paths
+const std::vector<std::string> uniqueResourcePaths( const std::vector<std::string>& sources )
+{
+    const std::unordered_set<std::string> unique_paths( sources.cbegin(), sources.cend() );
+    std::vector<std::string> paths;
+    std::copy_if( unique_paths.begin(), unique_paths.end(), std::back_inserter( paths ),
+                  [] ( const std::string& p ) { return !p.empty(); } );
+    return paths;
+}
+
+/*
+    Replace the entity and character references of a raw attribute value, as an XML parser does.
+*/
+const std::string unescapeAttribute( const std::string_view& raw )
+{
+    const std::array<std::pair<std::string_view, char>, 5> ENTITIES{ { { "&lt;", '<' }, { "&gt;", '>' }, { "&amp;", '&' },
+                                                                        { "&quot;", '"' }, { "&apos;", '\'' } } };
+    std::string value;
+    value.reserve( raw.size() );
+
+    for ( std::size_t i = 0; i < raw.size(); )
+    {
+        if ( raw[i] != '&' )
+        {
+            value += raw[i++];
+            continue;
+        }
+
+        const auto entity = std::find_if( ENTITIES.cbegin(), ENTITIES.cend(), [&raw, i] ( const auto& e )
+        {
+            return raw.compare( i, e.first.size(), e.first ) == 0;
+        } );
+        const std::size_t semicolon = raw.find( ';', i );
+        if ( entity != ENTITIES.cend() )
+        {
+            value += entity->second;
+            i += entity->first.size();
+        }
+        else if ( raw.compare( i, 2, "&#" ) == 0 && semicolon != std::string_view::npos )
+        {
+            // Character reference, written in UTF-8
+            const bool hex = ( i + 2 < raw.size() && ( raw[i + 2] == 'x' || raw[i + 2] == 'X' ) );
+            const std::string digits( raw.substr( i + ( hex ? 3 : 2 ), semicolon - i - ( hex ? 3 : 2 ) ) );
+            const unsigned long c = std::strtoul( digits.c_str(), nullptr, hex ? 16 : 10 );
+            if ( c < 0x80 )
+            {
+                value += static_cast<char>( c );
+            }
+            else if ( c < 0x800 )
+            {
+                value += static_cast<char>( 0xC0 | ( c >> 6 ) );
+                value += static_cast<char>( 0x80 | ( c & 0x3F ) );
+            }
+            else if ( c < 0x10000 )
+            {
+                value += static_cast<char>( 0xE0 | ( c >> 12 ) );
+                value += static_cast<char>( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+                value += static_cast<char>( 0x80 | ( c & 0x3F ) );
+            }
+            else
+            {
+                value += static_cast<char>( 0xF0 | ( c >> 18 ) );
+                value += static_cast<char>( 0x80 | ( ( c >> 12 ) & 0x3F ) );
+                value += static_cast<char>( 0x80 | ( ( c >> 6 ) & 0x3F ) );
+                value += static_cast<char>( 0x80 | ( c & 0x3F ) );
+            }
+            i = semicolon + 1;
+        }
+        else
+        {
+            value += raw[i++];
+        }
+    }
+    return value;
+}
+
+// Escape a value to be written between the quotes of an attribute
+const std::string escapeAttribute( const std::string& value )
+{
+    std::string escaped;
+    escaped.reserve( value.size() );
+    for ( const char c : value )
+    {
+        switch ( c )
+        {
+            case '<': escaped += "&lt;"; break;
+            case '>': escaped += "&gt;"; break;
+            case '&': escaped += "&amp;"; break;
+            case '"': escaped += "&quot;"; break;
+            case '\'': escaped += "&apos;"; break;
+            default: escaped += c; break;
+        }
+    }
+    return escaped;
+}
+
+/*
+    Scan an XML content without building any document, and give the raw value of the "src" attribute
+    of every resource element, with the name of the element, as its offset and its size in the content,
+    in the document order.
+    Comments, CDATA sections, processing instructions and the doctype are skipped.
+    Return the number of elements met. Throw InvalidXmlFileException if the markup is malformed:
+    an attribute without its value, a tag or a section that is not closed, an end tag that does not
+    close the current element, or an element that is still open at the end of the content.
+*/
+std::size_t scanResourceAttributes( const std::string_view& text,
+                                    const std::function<void( const std::string_view&, const std::size_t, const std::size_t )>& found )
+{
+    const std::size_t npos = std::string_view::npos;
+    const char * SPACES = " \t\r\n";
+    std::size_t element_count = 0;
+    std::vector<std::string_view> open_elements;
+    std::size_t pos = text.find( '<' );
+
+    // Position after the end of the markup starting at pos, that is closed by "close", or npos
+    const auto skipTo = [&text, npos] ( const std::size_t p, const std::string_view& close )
+    {
+        const std::size_t end = text.find( close, p );
+        return ( end == npos ) ? npos : end + close.size();
+    };
+
+    const auto fail = [&text] ( const std::size_t p, const std::string& problem )
+    {
+        const std::size_t line = std::count( text.cbegin(), text.cbegin() + p, '\n' ) + 1;
+        throw InvalidXmlFileException( problem + ", line " + std::to_string( line ) + " (offset " + std::to_string( p ) + ").\n" );
+    };
+
+    while ( pos != npos )
+    {
+        std::size_t next = npos;
+        if ( pos + 1 >= text.size() )
+        {
+            // A markup starting at the end of the content
+        }
+        else if ( text.compare( pos, 4, "<!--" ) == 0 )
+        {
+            next = skipTo( pos + 4, "-->" );
+        }
+        else if ( text.compare( pos, 9, "<![CDATA[" ) == 0 )
+        {
+            next = skipTo( pos + 9, "]]>" );
+        }
+        else if ( text[pos + 1] == '?' )
+        {
+            next = skipTo( pos + 2, "?>" );
+        }
+        else if ( text[pos + 1] == '!' )
+        {
+            // Doctype, with its internal subset if it has one
+            std::size_t end = text.find_first_of( "[>", pos + 2 );
+            end = ( end != npos && text[end] == '[' ) ? text.find( ']', end ) : end;
+            next = ( end == npos ) ? npos : skipTo( end, ">" );
+        }
+        else if ( text[pos + 1] == '/' )
+        {
+            const std::size_t end = text.find( '>', pos + 2 );
+            const std::string_view name = text.substr( pos + 2, std::min( end, text.find_first_of( SPACES, pos + 2 ) ) - pos - 2 );
+            if ( end != npos && ( open_elements.empty() || open_elements.back() != name ) )
+            {
+                fail( pos, "Unexpected end tag </" + std::string( name ) + ">" );
+            }
+            else if ( end != npos )
+            {
+                open_elements.pop_back();
+                next = end + 1;
+            }
+        }
+        else
+        {
+            // Start tag: the attributes are read to find the end of the tag, even if they are not needed
+            std::size_t p = text.find_first_of( " \t\r\n/>", pos + 1 );
+            const std::string_view name = text.substr( pos + 1, ( p == npos ? text.size() : p ) - pos - 1 );
+            const bool resource = std::find( RESOURCE_NAMES.cbegin(), RESOURCE_NAMES.cend(), name ) != RESOURCE_NAMES.cend();
+            element_count++;
+
+            while ( p != npos && ( p = text.find_first_not_of( SPACES, p ) ) != npos && text[p] != '>' && text[p] != '/' )
+            {
+                const std::size_t name_end = text.find_first_of( " \t\r\n=", p );
+                const std::size_t eq = ( name_end == npos ) ? npos : text.find_first_not_of( SPACES, name_end );
+                const std::size_t quote = ( eq == npos || text[eq] != '=' ) ? npos : text.find_first_not_of( SPACES, eq + 1 );
+                const std::size_t close = ( quote == npos || ( text[quote] != '"' && text[quote] != '\'' ) ) ?
+                                          npos : text.find( text[quote], quote + 1 );
+                if ( close == npos )
+                {
+                    fail( p, "Malformed attribute in the element \"" + std::string( name ) + "\"" );
+                }
+
+                if ( resource && text.substr( p, name_end - p ) == "src" )
+                {
+                    found( name, quote + 1, close - quote - 1 );
+                }
+                p = close + 1;
+            }
+
+            // An empty element is closed at once, any other one is open until its end tag
+            if ( p != npos && text[p] == '>' )
+            {
+                open_elements.push_back( name );
+                next = p + 1;
+            }
+            else if ( p != npos && text.compare( p, 2, "/>" ) == 0 )
+            {
+                next = p + 2;
+            }
+            else if ( p != npos )
+            {
+                fail( p, "Malformed end of the element \"" + std::string( name ) + "\"" );
+            }
+        }
+
+        if ( next == npos )
+        {
+            fail( pos, "Unexpected end of the content in a markup" );
+        }
+        pos = text.find( '<', next );
+    }
+
+    if ( !open_elements.empty() )
+    {
+        fail( text.size(), "The element \"" + std::string( open_elements.back() ) + "\" is not closed" );
+    }
+    return element_count;
+}
+
+// Locate the resource attributes of an XML content, and return the number of elements met
+std::size_t scanResourceList( const std::string_view& text, std::vector<ResourceAttribute>& attributes )
+{
+    attributes.clear();
+    return scanResourceAttributes( text, [&text, &attributes] ( const std::string_view& element, const std::size_t offset,
+                                                                const std::size_t size )
+    {
+        attributes.push_back( ResourceAttribute{ std::string( element ), offset, size,
+                                                 unescapeAttribute( text.substr( offset, size ) ), "" } );
+    } );
+}
+
+void configureExportedAttributes( std::vector<ResourceAttribute>& attributes, const std::vector<ExportedFile>& exported_files )
+{
+    program::log::Printer print = program::log::getPrinter();
+    for ( ResourceAttribute& a : attributes )
+    {
+        const fsys::path source = a.source;
+        auto exported_file = std::find_if( exported_files.cbegin(), exported_files.cend(), [&source] ( const ExportedFile& f )
+        {
+            return f.source == source;
+        });
+        if ( exported_file != exported_files.cend() )
+        {
+            a.target = exported_file->dest.string();
+            print << "-- " << a.element << ": \"" << fsys::normalize( a.target ) << "\".\n";
+        }
+    }
+}
+
+/*
+    The content with the new value of every configured attribute: the unchanged ranges of the content
+    are spliced with the escaped targets, so the rest of the project is kept byte for byte.
+*/
+const std::string patchedContent( const std::string_view& text, const std::vector<ResourceAttribute>& attributes )
+{
+    std::vector<std::string> values;
+    std::size_t size = text.size();
+    for ( const ResourceAttribute& a : attributes )
+    {
+        values.push_back( a.target.empty() ? std::string() : escapeAttribute( a.target ) );
+        size += a.target.empty() ? 0 : values.back().size() - a.size;
+    }
+
+    std::string content;
+    content.reserve( size );
+    std::size_t last = 0;
+    for ( std::size_t i = 0; i < attributes.size(); i++ )
+    {
+        if ( !attributes[i].target.empty() )
+        {
+            content.append( text, last, attributes[i].offset - last );
+            content += values[i];
+            last = attributes[i].offset + attributes[i].size;
+        }
+    }
+    content.append( text, last, std::string_view::npos );
+    return content;
+}
+
+const std::string readTextFile( const std::string& file )
+{
+    std::ifstream infile( file, std::ios::binary );
+    std::stringstream ss;
+    ss << infile.rdbuf();
+    return ss.str();
+}
+
+// Write the whole content in one go
+bool writeTextFile( const std::string& file, const std::string& content )
+{
+    std::ofstream outfile( file, std::ios::binary | std::ios::trunc );
+    outfile.write( content.data(), content.size() );
+    return static_cast<bool>( outfile.flush() );
+}
+
+bool checkLMMSProjectDocument( const tinyxml2::XMLDocument& doc, const tinyxml2::XMLError tinycode )
 {
     const char * ROOT_NAME = "lmms-project";
     const char * PROJECT_TYPE_NAME = "type";
@@ -43,8 +475,6 @@ bool checkLMMSProjectBuffer( const std::unique_ptr<char []>& buffer, const unsig
     program::log::Printer print = program::log::getPrinter();
 
     bool valid_project = false;
-    tinyxml2::XMLDocument doc;
-    tinyxml2::XMLError tinycode = doc.Parse( buffer.get(), bufsize );
 
     if ( tinycode == tinyxml2::XML_SUCCESS )
     {
@@ -97,8 +527,27 @@ bool checkLMMSProjectBuffer( const std::unique_ptr<char []>& buffer, const unsig
     return valid_project;
 }
 
+}
+
+bool checkLMMSProjectBuffer( const std::unique_ptr<char []>& buffer, const unsigned int bufsize )
+{
+    return checkLMMSProjectBuffer( buffer.get(), bufsize );
+}
+
+bool checkLMMSProjectBuffer( const char * buffer, const std::size_t bufsize )
+{
+    tinyxml2::XMLDocument doc;
+    const tinyxml2::XMLError tinycode = parseProjectHead( doc, buffer, bufsize );
+    return checkLMMSProjectDocument( doc, tinycode );
+}
+
 
 bool projectInfo( const std::unique_ptr<char []>& buffer, const unsigned int bufsize )
+{
+    return projectInfo( buffer.get(), bufsize );
+}
+
+bool projectInfo( const char * buffer, const std::size_t bufsize )
 {
     const char * HEAD_NAME = "head";
     const char * ROOT_NAME = "lmms-project";
@@ -109,7 +558,7 @@ bool projectInfo( const std::unique_ptr<char []>& buffer, const unsigned int buf
     const char * BPM_ATTRIBUTE = "bpm";
 
     tinyxml2::XMLDocument doc;
-    tinyxml2::XMLError tinycode = doc.Parse( buffer.get(), bufsize );
+    tinyxml2::XMLError tinycode = parseProjectHead( doc, buffer, bufsize );
 
     if ( tinycode == tinyxml2::XML_SUCCESS )
     {
@@ -162,92 +611,108 @@ bool projectInfo( const std::unique_ptr<char []>& buffer, const unsigned int buf
     return true;
 }
 
-const std::vector<std::string> retrieveResourcesFromXmlFile( const std::string& xml_file )
-{
-    tinyxml2::XMLDocument doc;
-    doc.LoadFile( xml_file.c_str() );
 
-    const tinyxml2::XMLElement * root = doc.RootElement();
-    if ( root == nullptr )
+bool ProjectDocument::loadFile( const std::string& project_file )
+{
+    std::ifstream infile( project_file, std::ios::binary );
+    if ( !infile.is_open() )
     {
-        throw InvalidXmlFileException( "No root element. Are you sure this file contains an XML content?\n" );
+        text.clear();
+        attributes.clear();
+        element_count = 0;
+        scan_error.clear();
+        tinycode = tinyxml2::XML_ERROR_FILE_NOT_FOUND;
+        return false;
     }
 
-    const std::vector<std::string> NAMES{ "audiofileprocessor", "sf2player", "sampletco" };
-    const std::vector<const tinyxml2::XMLElement *>& elements = xml::getAllElementsByNames<const tinyxml2::XMLElement>( root, NAMES );
+    std::stringstream ss;
+    ss << infile.rdbuf();
+    return parse( ss.str() );
+}
 
-    std::unordered_set<std::string> unique_paths;
-    for ( const tinyxml2::XMLElement * e : elements )
+bool ProjectDocument::parse( const std::string& content )
+{
+    // Only the head is parsed to check the project, the resources are located by a scan of the content
+    text = content;
+    tinycode = parseProjectHead( head, text.c_str(), text.size() );
+    scan_error.clear();
+    try
     {
-        unique_paths.insert( e->Attribute( "src" ) );
+        element_count = scanResourceList( text, attributes );
     }
-
-    std::vector<std::string> paths;
-    std::copy_if( unique_paths.begin(), unique_paths.end(), std::back_inserter( paths ),
-                  [] ( const std::string& p ) { return !p.empty(); } );
-    return paths;
+    catch ( const InvalidXmlFileException& e )
+    {
+        // The project is then invalid, and the caller decides what to do with it
+        attributes.clear();
+        element_count = 0;
+        scan_error = e.what();
+    }
+    return tinycode == tinyxml2::XML_SUCCESS && scan_error.empty();
 }
 
-void configureExportedXmlFile( const std::string& project_file, const std::vector<ExportedFile>& exported_files )
+bool ProjectDocument::isValidProject() const
 {
-    program::log::Printer print = program::log::getPrinter();
-    tinyxml2::XMLDocument doc;
-    doc.LoadFile( project_file.c_str() );
-
-    const tinyxml2::XMLElement * root = doc.RootElement();
-    if ( root == nullptr )
+    if ( !scan_error.empty() )
     {
-        /// At this point, this part must not be reachable
-        throw PackageImportException( "FATAL ERROR: The exported project file is invalid." );
+        std::cerr << "ERROR: " << scan_error;
+        return false;
     }
+    return checkLMMSProjectDocument( head, tinycode );
+}
 
-    const std::vector<std::string> NAMES{ "audiofileprocessor", "sf2player", "sampletco" };
-    const std::vector<tinyxml2::XMLElement *>& elements = xml::getAllElementsByNames<tinyxml2::XMLElement>( root, NAMES );
+std::vector<ResourceAttribute>& ProjectDocument::resourceAttributes()
+{
+    if ( element_count == 0 )
+    {
+        throw InvalidXmlFileException( "No root element. Are you sure this file contains an XML content?\n" );
+    }
+    return attributes;
+}
 
-    for ( tinyxml2::XMLElement * e : elements )
+const std::vector<std::string> ProjectDocument::resources()
+{
+    std::vector<std::string> sources;
+    for ( const ResourceAttribute& a : resourceAttributes() )
     {
-        const fsys::path source = std::string( e->Attribute( "src" ) );
-        auto exported_file = std::find_if( exported_files.cbegin(), exported_files.cend(), [&source] ( const ExportedFile& f )
-        {
-            return f.source == source;
-        });
-        if ( exported_file != exported_files.cend() )
-        {
-            const std::string& target = exported_file->dest.string();
-            print << "-- " << e->Name() << ": \"" << fsys::normalize( target ) << "\".\n";
-            e->SetAttribute( "src", target.c_str() );
-        }
+        sources.push_back( a.source );
     }
+    return uniqueResourcePaths( sources );
+}
 
-    tinyxml2::XMLError code = doc.SaveFile( project_file.c_str() );
-    if ( code != tinyxml2::XMLError::XML_SUCCESS )
+void ProjectDocument::configureExportedFiles( const std::vector<ExportedFile>& exported_files )
+{
+    configureExportedAttributes( resourceAttributes(), exported_files );
+}
+
+void ProjectDocument::saveFile( const std::string& project_file )
+{
+    if ( !writeTextFile( project_file, content() ) )
     {
-        throw PackageExportException( "ERROR: Export failed : cannot save updated configuration into the project" +
-                                       std::string( doc.ErrorStr() ) );
+        throw PackageExportException( "ERROR: Export failed : cannot save updated configuration into the project " + project_file );
     }
 }
 
+const std::string ProjectDocument::content() const
+{
+    return patchedContent( text, attributes );
+}
+
 
 void configureImportedProject( const std::string& project_file, const std::vector<std::string>& resources )
 {
     program::log::Printer print = program::log::getPrinter();
-    tinyxml2::XMLDocument doc;
-    doc.LoadFile( project_file.c_str() );
+    const std::string& content = readTextFile( project_file );
 
-    const tinyxml2::XMLElement * root = doc.RootElement();
-    if ( root == nullptr )
+    std::vector<ResourceAttribute> attributes;
+    if ( scanResourceList( content, attributes ) == 0 )
     {
         /// At this point, this part must not be reachable
         throw PackageImportException( "ERROR:The imported project file is invalid." );
     }
 
-    const std::vector<std::string> NAMES{ "audiofileprocessor", "sf2player", "sampletco" };
-    const std::vector<tinyxml2::XMLElement *>& elements = xml::getAllElementsByNames<tinyxml2::XMLElement>( root, NAMES );
-
-    for ( tinyxml2::XMLElement * e : elements )
+    for ( ResourceAttribute& a : attributes )
     {
-        const std::string source( e->Attribute( "src" ) );
-        const std::string& filename = fsys::path( source ).filename().string();
+        const std::string& filename = fsys::path( a.source ).filename().string();
         auto found = std::find_if( resources.cbegin(), resources.cend(), [&filename] ( const std::string& resource )
         {
             return fsys::path( resource ).filename().string() == filename;
@@ -255,18 +720,15 @@ void configureImportedProject( const std::string& project_file, const std::vecto
 
         if ( found != resources.cend() )
         {
-            print << "-- Configure \"" << e->Name() << "\" with \"" << filename << "\" in project. \n";
-            const std::string& resource_found = fsys::absolute( ( *found ) ).string();
-            print << "-- Set \"" << fsys::normalize( resource_found ) << "\" in project file. \n";
-            e->SetAttribute( "src", resource_found.c_str() );
+            print << "-- Configure \"" << a.element << "\" with \"" << filename << "\" in project. \n";
+            a.target = fsys::absolute( ( *found ) ).string();
+            print << "-- Set \"" << fsys::normalize( a.target ) << "\" in project file. \n";
         }
     }
 
-    tinyxml2::XMLError code = doc.SaveFile( project_file.c_str() );
-    if ( code != tinyxml2::XMLError::XML_SUCCESS )
+    if ( !writeTextFile( project_file, patchedContent( content, attributes ) ) )
     {
-        throw PackageImportException( "ERROR: Import failed : cannot save updated configuration into the project" +
-                                      std::string( doc.ErrorStr() ) );
+        throw PackageImportException( "ERROR: Import failed : cannot save updated configuration into the project " + project_file );
     }
 }
 
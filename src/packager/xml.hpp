@@ -46,24 +46,58 @@ namespace xml
     A valid project is a song project generated by a supported version of LMMS.
 */
 bool checkLMMSProjectBuffer( const std::unique_ptr<char []>& buffer, const unsigned int bufsize );
+bool checkLMMSProjectBuffer( const char * buffer, const std::size_t bufsize );
 bool projectInfo( const std::unique_ptr<char []>& buffer, const unsigned int bufsize );
+bool projectInfo( const char * buffer, const std::size_t bufsize );
 
 // Export
 
-const std::vector<std::string> retrieveResourcesFromXmlFile( const std::string& xml_file );
-void configureExportedXmlFile( const std::string& project_file, const std::vector<ExportedFile>& exported_files );
+// The "src" attribute of a resource element, located by its raw value in the content of a project
+struct ResourceAttribute
+{
+    std::string element;    // name of the element
+    std::size_t offset;     // where the value starts in the content, after the quote
+    std::size_t size;       // size of the raw value
+    std::string source;     // unescaped value
+    std::string target;     // new value, if the attribute is configured
+};
+
+/*
+    A project file read once to be packaged: it is checked from its head, its resources are located
+    by a single scan of the content, and the configured project is written as the original content
+    where only the values of the configured attributes are replaced.
+*/
+class ProjectDocument final
+{
+private:
+    std::string text;
+    tinyxml2::XMLDocument head;
+    tinyxml2::XMLError tinycode = tinyxml2::XML_ERROR_EMPTY_DOCUMENT;
+    std::vector<ResourceAttribute> attributes;
+    std::size_t element_count = 0;
+    std::string scan_error;             // why the content could not be scanned, if it could not
+
+    std::vector<ResourceAttribute>& resourceAttributes();
+
+public:
+    ProjectDocument() = default;
+    ProjectDocument( const ProjectDocument& ) = delete;
+    ProjectDocument& operator =( const ProjectDocument& ) = delete;
+
+    bool loadFile( const std::string& project_file );
+    bool parse( const std::string& content );
+    bool isValidProject() const;
+    const std::vector<std::string> resources();
+    void configureExportedFiles( const std::vector<ExportedFile>& exported_files );
+    void saveFile( const std::string& project_file );
+    const std::string content() const;
+    ~ProjectDocument() = default;
+};
 
 // Import
 
 void configureImportedProject( const std::string& project_file, const std::vector<std::string>& resources );
 
-// Misc
-
-template<typename T>
-const std::vector<T *> getAllElementsByNames( const tinyxml2::XMLElement * root, const std::vector<std::string>& names );
-
 }
 
-#include "xml.tpp"
-
 #endif // XML_HPP_INCLUDED
@@ -43,8 +43,9 @@ void usage ( const std::string& progname )
     std::cerr << "Usage: \n"
               << p << " --check  [--verbose] <file>\n"
               << p << " --info   [--verbose] <file>\n"
-              << p << " --pack   [--no-zip] [--sf2] [--verbose] [--lmms-exe <exe_file>] [--rsc-dirs <path/to/data>] --target <dir> <file>\n"
-              << p << " --unpack [--verbose] --target <dir> <file>\n\n";
+              << p << " --pack   [--no-zip | --stream] [--deflate-all] [--level <0-9> | --fast | --best] [--sf2] [--verbose] [--jobs <n>] [--lmms-exe <exe_file>] [--rsc-dirs <path/to/data>] [--rsc-index <file>] [--update <old.mmpk>] [--delta <base.mmpk>] --target <dir> <file>\n"
+              << p << " --unpack [--verbose] [--jobs <n>] [--base <base.mmpk> [<delta.mmpk>...]] --target <dir> <file>\n"
+              << p << " --batch  [--no-zip | --stream] [--deflate-all] [--level <0-9> | --fast | --best] [--sf2] [--verbose] [--jobs <n>] [--lmms-exe <exe_file>] [--rsc-dirs <path/to/data>] [--rsc-index <file>] <manifest>\n\n";
 }
 
 
@@ -57,14 +58,25 @@ void help ( const std::string& progname )
               << "-i, --info       " << "Get information about the file\n"
               << "-p, --pack       " << "Package the file\n"
               << "-u, --unpack     " << "Unpack the package and import the project\n"
+              << "-b, --batch      " << "Package every project of the manifest (one \"<project> <tab> <target dir>\" per line) in one run\n"
               << "-h, --help       " << "Display the manual\n"
               << "--version        " << "Get the version of the program\n\n"
               << "Options:\n"
               << "-t, --target     " << "(Mandatory for import and export) Set the destination directory\n"
               << "--no-zip         " << "Do not compress the destination directory (Export)\n"
-              << "--lmms-exe       " << "Specify the executable file to use to in order to decompress the project\n"
+              << "--stream         " << "Write the package file directly, without creating the destination directory (Export)\n"
+              << "--lmms-exe       " << "Specify the LMMS executable used to decompress the project if it cannot be done natively\n"
               << "--rsc_dirs       " << "Provide directories where some missing external samples are located (Export)\n"
+              << "--rsc-index      " << "Index file of the resource directories, default: $XDG_CACHE_HOME/lmms-pkg/rsc-index (Export)\n"
+              << "--update         " << "Copy the files that did not change from a previous package instead of compressing them again (Export)\n"
+              << "--delta          " << "Make a delta package that only has the files whose content is not in the base package, whatever their name (Export)\n"
+              << "--base           " << "Full package, then the delta packages, that the delta package to unpack is based on (Import)\n"
+              << "--deflate-all    " << "Also deflate the files that look already compressed: OGG, FLAC, MP3... or a first block that deflate cannot reduce (Export)\n"
+              << "--level          " << "Compression level of the package, from 0 (no compression) to 9, default: 8 (Export)\n"
+              << "--fast           " << "Compress faster, same as --level 1 (Export)\n"
+              << "--best           " << "Compress better, same as --level 9 (Export)\n"
               << "--sf2            " << "Include SoundFont2 files in the package at export (Export)\n"
+              << "-j, --jobs       " << "Number of threads used to copy and compress the resources, or to extract them, default: number of CPUs (Export, Import)\n"
               << "-v, --verbose    " << "Verbose mode\n\n";
 
 }
@@ -128,6 +140,13 @@ int run( const int argc, const char * argv[] )
                 return EXIT_FAILURE;
             }
         }
+        else if ( options.operation == options::OperationType::Batch )
+        {
+            if ( !Packager::batchPack( options ) )
+            {
+                return EXIT_FAILURE;
+            }
+        }
     }
     catch ( std::invalid_argument& e )
     {